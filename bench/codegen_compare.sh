@@ -0,0 +1,123 @@
+#!/usr/bin/env bash
+# Compares the code two compiler builds generate for the same programs:
+# static instruction count, memory operands, .text size, exit code and the
+# average runtime of the produced binary.
+#
+#   bench/codegen_compare.sh <baseline-compiler> <candidate-compiler> [program.cl ...]
+#
+# Without programs, synthetic ones are generated. BASELINE_FLAGS and
+# CANDIDATE_FLAGS are passed to the respective compiler (e.g.
+# CANDIDATE_FLAGS=--regs=4; the same binary with BASELINE_FLAGS=-O0 and
+# CANDIDATE_FLAGS=-O1 isolates the optimizer), RUNS sets how often each
+# binary is executed (default 200). Builds that write the executable
+# themselves are measured by disassembling it when no output.asm exists.
+#
+# Every value in the language is a compile-time constant, so -O1 folds all
+# multiplication and division by constants before code generation. The
+# generator's strength reduction of them only shows up at -O0
+# (BASELINE_FLAGS=-O0 CANDIDATE_FLAGS=-O0 against an older build).
+set -euo pipefail
+
+if [[ $# -lt 2 ]]; then
+    sed -n '2,18p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+
+baseline=$(realpath "$1")
+candidate=$(realpath "$2")
+shift 2
+runs=${RUNS:-200}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Straight-line arithmetic: `count` lets, each combining earlier variables.
+gen_lets() {
+    awk -v n="$1" 'BEGIN {
+        srand(7);
+        print "let v0 = 1;";
+        for (i = 1; i < n; i++) {
+            a = int(rand() * i); b = int(rand() * i); c = int(rand() * 9) + 1;
+            printf "let v%d = (v%d + %d) * (v%d - v%d + %d) / %d + v%d;\n", i, a, c, b, a, c, c, int(rand() * i);
+        }
+        printf "exit(v%d);\n", n - 1;
+    }'
+}
+
+# Deeply nested parenthesised expressions that exhaust the register pool.
+gen_deep() {
+    awk -v n="$1" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            e = "1";
+            for (d = 0; d < 16; d++) {
+                e = "(" e " + " (d + 2) ") * (" d + 3 " - " e ")";
+                if (length(e) > 4000) break;
+            }
+            printf "let x%d = %s;\n", i, e;
+        }
+        printf "exit(x%d);\n", n - 1;
+    }'
+}
+
+# Nested scopes and ifs with shadowed variables.
+gen_scopes() {
+    awk -v n="$1" 'BEGIN {
+        print "let a = 3;";
+        for (i = 0; i < n; i++) {
+            printf "{ let a = a + %d; let b = a * 2; if (b - a) { let c = b / a + %d; exit(c); } }\n", i, i;
+        }
+        print "exit(a);";
+    }'
+}
+
+programs=("$@")
+if [[ ${#programs[@]} -eq 0 ]]; then
+    gen_lets 2000 > "$work/lets.cl"
+    gen_deep 50 > "$work/deep.cl"
+    gen_scopes 500 > "$work/scopes.cl"
+    programs=("$work/lets.cl" "$work/deep.cl" "$work/scopes.cl")
+fi
+
+# Prints "<instructions> <memory operands> <text bytes> <exit code> <us per run>"
+measure() {
+    local dir=$1 asm=$1/output.asm
+    local insts mem text code start end
+    if [[ ! -f $asm ]]; then
+        asm=$dir/output.dis
+        objdump -d -M intel --no-show-raw-insn "$dir/output" | grep -P '^\s+[0-9a-f]+:\t' | sed 's/^[^\t]*//' > "$asm"
+    fi
+    insts=$(grep -c $'^\t' "$asm" || true)
+    mem=$(grep -cE $'^\t(push|pop)|\\[' "$asm" || true)
+    text=$(size -A "$dir/output" | awk '$1 == ".text" { print $2 }')
+    set +e
+    "$dir/output"
+    code=$?
+    start=$(date +%s%N)
+    for ((i = 0; i < runs; i++)); do "$dir/output"; done
+    end=$(date +%s%N)
+    set -e
+    echo "$insts $mem $text $code $(((end - start) / runs / 1000))"
+}
+
+compile() {
+    local compiler=$1 program=$2 dir=$3
+    shift 3
+    mkdir -p "$dir"
+    (cd "$dir" && "$compiler" "$@" "$program" > compile.out 2>&1) || {
+        echo "compilation of $program failed, see $dir/compile.out" >&2
+        exit 1
+    }
+}
+
+printf "%-12s %-9s %8s %8s %8s %5s %8s\n" program build insts mem_ops text exit us/run
+for program in "${programs[@]}"; do
+    name=$(basename "$program")
+    compile "$baseline" "$(realpath "$program")" "$work/base" ${BASELINE_FLAGS:-}
+    compile "$candidate" "$(realpath "$program")" "$work/cand" ${CANDIDATE_FLAGS:-}
+    read -r bi bm bt bc bu < <(measure "$work/base")
+    read -r ci cm ct cc cu < <(measure "$work/cand")
+    printf "%-12s %-9s %8s %8s %8s %5s %8s\n" "$name" baseline "$bi" "$bm" "$bt" "$bc" "$bu"
+    printf "%-12s %-9s %8s %8s %8s %5s %8s\n" "" candidate "$ci" "$cm" "$ct" "$cc" "$cu"
+    if [[ $bc != "$cc" ]]; then
+        echo "  exit codes differ" >&2
+    fi
+done
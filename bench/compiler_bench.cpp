@@ -0,0 +1,278 @@
+// Compiler benchmark suite. Generates the synthetic workloads of
+// workloads.hpp in memory and times, for each of them:
+//
+//   tokenize   Tokenizer::tokenize()
+//   parse      Parser::parse_prog() on the pre-tokenized program
+//   codegen    Generator construction (register allocation) and gen_prog()
+//              on the unoptimised IR, so it always has real work to do
+//   end2end    every step from the source text to encoded machine code at
+//              the chosen optimisation level, without touching the disk
+//
+// Each benchmark is repeated after warm-up runs and reported as the median
+// with its median absolute deviation (MAD), which a few noisy runs do not
+// move. --save writes the medians to a file; --compare reads such a file and
+// marks changes that exceed both 2% and three times the combined MAD.
+//
+//   cosarch_bench [--size=MB] [--reps=N] [--warmup=N] [--opt=0|1|2]
+//                 [--workloads=lets,deep,...] [--save=FILE] [--compare=FILE]
+//                 [--write=DIR]
+//
+// --write=DIR only writes the workloads as DIR/<name>.cos (for timing the
+// compiler binary itself) and runs nothing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/encoder.hpp"
+#include "../src/generation.hpp"
+#include "../src/ir_builder.hpp"
+#include "../src/ir_optimizer.hpp"
+#include "../src/optimizer.hpp"
+#include "../src/parser.hpp"
+#include "../src/peephole.hpp"
+#include "../src/tokenization.hpp"
+#include "workloads.hpp"
+
+namespace {
+    struct Settings {
+        double megabytes = 4;
+        int repetitions = 7;
+        int warmup = 1;
+        int opt_level = 2;
+        std::vector<std::string> workloads;
+        std::string save;
+        std::string compare;
+        std::string write;
+    };
+
+    struct Result {
+        double median_ms = 0;
+        double mad_ms = 0;
+        double best_ms = 0;
+    };
+
+    void usage() {
+        std::cerr << "usage: cosarch_bench [--size=MB] [--reps=N] [--warmup=N] [--opt=0|1|2]\n"
+                     "                     [--workloads=lets,deep,scopes,comments,mixed]\n"
+                     "                     [--save=FILE] [--compare=FILE] [--write=DIR]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    Settings parse_settings(int argc, char *argv[]) {
+        Settings settings;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const size_t equals = arg.find('=');
+            if (equals == std::string::npos) {
+                usage();
+            }
+            const std::string key = arg.substr(0, equals);
+            const std::string value = arg.substr(equals + 1);
+            if (key == "--size") {
+                settings.megabytes = std::strtod(value.c_str(), nullptr);
+            } else if (key == "--reps") {
+                settings.repetitions = std::max(1, std::atoi(value.c_str()));
+            } else if (key == "--warmup") {
+                settings.warmup = std::max(0, std::atoi(value.c_str()));
+            } else if (key == "--opt") {
+                settings.opt_level = std::clamp(std::atoi(value.c_str()), 0, 2);
+            } else if (key == "--workloads") {
+                std::stringstream names(value);
+                for (std::string name; std::getline(names, name, ',');) {
+                    settings.workloads.push_back(name);
+                }
+            } else if (key == "--save") {
+                settings.save = value;
+            } else if (key == "--compare") {
+                settings.compare = value;
+            } else if (key == "--write") {
+                settings.write = value;
+            } else {
+                usage();
+            }
+        }
+        return settings;
+    }
+
+    double median_of(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const size_t middle = values.size() / 2;
+        return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+    }
+
+    // `setup` runs before every repetition and is not timed; `run` is.
+    Result measure(const Settings &settings, const std::function<void()> &setup, const std::function<void()> &run) {
+        std::vector<double> times;
+        for (int rep = -settings.warmup; rep < settings.repetitions; ++rep) {
+            setup();
+            const auto begin = std::chrono::steady_clock::now();
+            run();
+            const auto end = std::chrono::steady_clock::now();
+            if (rep >= 0) {
+                times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+            }
+        }
+        Result result;
+        result.median_ms = median_of(times);
+        std::vector<double> deviations;
+        for (const double time: times) {
+            deviations.push_back(std::abs(time - result.median_ms));
+        }
+        result.mad_ms = median_of(deviations);
+        result.best_ms = *std::min_element(times.begin(), times.end());
+        return result;
+    }
+
+    // The whole pipeline of the compiler driver, minus file I/O.
+    size_t compile(std::string_view src, int opt_level) {
+        Interner names(src.size() / 256);
+        Tokenizer tokenizer(src, names);
+        Parser parser(tokenizer.tokenize(), src);
+        std::optional<Ast> prog = parser.parse_prog();
+        if (opt_level >= 1) {
+            (void) Optimizer(prog.value(), names).run();
+        }
+        IrProgram ir = IrBuilder(prog.value(), names).build();
+        if (opt_level >= 1) {
+            (void) IrOptimizer().run(ir);
+        }
+        std::vector<Instr> code = Generator(ir).gen_prog();
+        if (opt_level >= 2) {
+            (void) Peephole().run(code);
+        }
+        return X86Encoder().encode(code).size();
+    }
+
+    using Baseline = std::map<std::pair<std::string, std::string>, Result>;
+
+    Baseline read_baseline(const std::string &path) {
+        Baseline baseline;
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "cannot read baseline " << path << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        std::string workload;
+        std::string benchmark;
+        Result result;
+        while (file >> workload >> benchmark >> result.median_ms >> result.mad_ms >> result.best_ms) {
+            baseline[{workload, benchmark}] = result;
+        }
+        return baseline;
+    }
+
+    std::string compare_to(const Result &now, const Result &before) {
+        const double change = (now.median_ms - before.median_ms) / before.median_ms * 100.0;
+        const double noise = 3.0 * (now.mad_ms + before.mad_ms) / before.median_ms * 100.0;
+        std::ostringstream out;
+        out << std::showpos << std::fixed << std::setprecision(1) << change << "%" << std::noshowpos;
+        if (std::abs(change) > std::max(2.0, noise)) {
+            out << (change > 0 ? " slower" : " faster");
+        } else {
+            out << " (noise)";
+        }
+        return out.str();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const Settings settings = parse_settings(argc, argv);
+    const auto target_bytes = static_cast<size_t>(settings.megabytes * 1024 * 1024);
+
+    std::vector<Workloads::Workload> selected;
+    for (const Workloads::Workload &workload: Workloads::all) {
+        if (settings.workloads.empty() ||
+            std::find(settings.workloads.begin(), settings.workloads.end(), workload.name) !=
+            settings.workloads.end()) {
+            selected.push_back(workload);
+        }
+    }
+    if (selected.empty()) {
+        usage();
+    }
+
+    if (!settings.write.empty()) {
+        for (const Workloads::Workload &workload: selected) {
+            const std::string path = settings.write + "/" + std::string(workload.name) + ".cos";
+            std::ofstream file(path, std::ios::binary);
+            file << workload.generate(target_bytes);
+            if (!file) {
+                std::cerr << "cannot write " << path << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::cout << "wrote " << path << std::endl;
+        }
+        return 0;
+    }
+
+    const Baseline baseline = settings.compare.empty() ? Baseline{} : read_baseline(settings.compare);
+    std::ofstream save;
+    if (!settings.save.empty()) {
+        save.open(settings.save);
+    }
+
+    std::cout << "size " << settings.megabytes << " MB, " << settings.repetitions << " repetition(s) after "
+              << settings.warmup << " warm-up, -O" << settings.opt_level << std::endl;
+    std::cout << std::left << std::setw(10) << "workload" << std::setw(10) << "benchmark" << std::right
+              << std::setw(12) << "median ms" << std::setw(10) << "MAD ms" << std::setw(12) << "best ms"
+              << std::setw(10) << "MB/s" << (baseline.empty() ? "" : "  vs. baseline") << std::endl;
+
+    for (const Workloads::Workload &workload: selected) {
+        const std::string src = workload.generate(target_bytes);
+        const double mb = static_cast<double>(src.size()) / (1024.0 * 1024.0);
+
+        // Inputs of the isolated benchmarks, prepared once and outside the
+        // timed region.
+        Interner names(src.size() / 256);
+        const std::vector<Token> tokens = Tokenizer(src, names).tokenize();
+        // The AST lives in the arena of the parser that built it.
+        Parser setup_parser(tokens, src);
+        const Ast ast = *setup_parser.parse_prog();
+        const IrProgram ir = IrBuilder(ast, names).build();
+        std::optional<Parser> parser;
+        std::optional<Generator> generator;
+
+        const std::pair<std::string_view, Result> results[] = {
+                {"tokenize", measure(settings, [] {}, [&] {
+                    Interner run_names(src.size() / 256);
+                    (void) Tokenizer(src, run_names).tokenize();
+                })},
+                {"parse", measure(settings, [&] { parser.emplace(tokens, src); }, [&] {
+                    (void) parser->parse_prog();
+                })},
+                {"codegen", measure(settings, [&] { generator.reset(); }, [&] {
+                    generator.emplace(ir);
+                    (void) generator->gen_prog();
+                })},
+                {"end2end", measure(settings, [] {}, [&] { (void) compile(src, settings.opt_level); })},
+        };
+
+        for (const auto &[benchmark, result]: results) {
+            std::cout << std::left << std::setw(10) << workload.name << std::setw(10) << benchmark << std::right
+                      << std::fixed << std::setprecision(3) << std::setw(12) << result.median_ms << std::setw(10)
+                      << result.mad_ms << std::setw(12) << result.best_ms << std::setprecision(1) << std::setw(10)
+                      << mb / (result.median_ms / 1000.0);
+            const auto before = baseline.find({std::string(workload.name), std::string(benchmark)});
+            if (before != baseline.end()) {
+                std::cout << "  " << compare_to(result, before->second);
+            }
+            std::cout << std::endl;
+            if (save.is_open()) {
+                save << workload.name << ' ' << benchmark << ' ' << result.median_ms << ' ' << result.mad_ms << ' '
+                     << result.best_ms << '\n';
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Lexer throughput benchmark. Builds a synthetic Cosmolang program in memory
+// and reports how many MB/s Tokenizer::tokenize() sustains on it, once per
+// scan level. Every level has to produce the scalar level's token stream.
+//
+//   cosarch_lex_bench [size in MB] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/tokenization.hpp"
+#include "workloads.hpp"
+
+static bool same_tokens(const std::vector<Token> &a, const std::vector<Token> &b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Token &x, const Token &y) {
+        return x.type == y.type && x.offset == y.offset && x.length == y.length && x.ident == y.ident;
+    });
+}
+
+int main(int argc, char *argv[]) {
+    const size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+    const int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    const std::string src = Workloads::mixed(megabytes * 1024 * 1024);
+    const double mb = static_cast<double>(src.size()) / (1024.0 * 1024.0);
+    Interner names;
+    const std::vector<Token> reference = Tokenizer(src, names, ScanLevel::scalar).tokenize();
+    std::cout << "Source: " << mb << " MB, " << reference.size() << " tokens" << std::endl;
+
+    const std::pair<const char *, ScanLevel> levels[] = {
+            {"scalar", ScanLevel::scalar},
+            {"sse2",   ScanLevel::sse2},
+            {"avx2",   ScanLevel::avx2},
+    };
+    for (const auto &[name, level]: levels) {
+        if (level > best_scan_level()) {
+            std::cout << name << ": not supported on this machine" << std::endl;
+            continue;
+        }
+        std::vector<double> seconds;
+        for (int rep = 0; rep < repetitions; ++rep) {
+            const auto begin = std::chrono::steady_clock::now();
+            Interner level_names;
+            Tokenizer tokenizer(src, level_names, level);
+            const std::vector<Token> tokens = tokenizer.tokenize();
+            const auto end = std::chrono::steady_clock::now();
+            seconds.push_back(std::chrono::duration<double>(end - begin).count());
+            if (rep == 0 && !same_tokens(tokens, reference)) {
+                std::cerr << name << ": token stream differs from the scalar scanner" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        std::sort(seconds.begin(), seconds.end());
+        const double median = seconds[seconds.size() / 2];
+        std::cout << name << ": median " << median * 1000.0 << " ms (" << mb / median << " MB/s), best "
+                  << seconds.front() * 1000.0 << " ms (" << mb / seconds.front() << " MB/s)" << std::endl;
+    }
+    return 0;
+}
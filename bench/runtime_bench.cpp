@@ -0,0 +1,405 @@
+// Runtime benchmark for the code the compiler generates. Compiles a corpus
+// of programs with one or more compiler configurations, runs every produced
+// executable many times and reports the median user-space cycles,
+// instructions, branch misses and L1 data cache misses, read with
+// perf_event_open(). Where the counters are unavailable (no PMU, a
+// restrictive perf_event_paranoid, not Linux) only the wall-clock time of
+// each run is reported. Every configuration after the first is compared
+// against the first one, and the exit codes of all of them have to agree.
+//
+//   cosarch_runtime_bench --config=NAME=COMPILER[,FLAG...] [--config=...]
+//                         [--runs=N] [--size=KB] [--workloads=lets,deep,...]
+//                         [program.cos ...]
+//
+// For example, -O0 against -O2 of the same build:
+//
+//   cosarch_runtime_bench --config=O0=./CosmoArchitecture,-O0 --config=O2=./CosmoArchitecture,-O2
+//
+// Without program files the workloads of workloads.hpp are generated at
+// --size kilobytes each (default 64).
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#define COSARCH_HAS_PERF 1
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#else
+#define COSARCH_HAS_PERF 0
+#endif
+
+#include "workloads.hpp"
+
+namespace {
+    struct Config {
+        std::string name;
+        std::string compiler;
+        std::vector<std::string> flags;
+    };
+
+    struct Program {
+        std::string name;
+        std::filesystem::path source;
+    };
+
+    struct Settings {
+        std::vector<Config> configs;
+        std::vector<Program> programs;
+        std::vector<std::string> workloads;
+        int runs = 50;
+        size_t kilobytes = 64;
+    };
+
+    enum Counter : size_t {
+        cycles,
+        instructions,
+        branch_misses,
+        l1d_misses,
+        counter_count,
+    };
+
+    constexpr std::array<const char *, counter_count> counter_names = {
+            "cycles", "instructions", "branch-misses", "L1d-misses",
+    };
+
+    struct Run {
+        std::array<std::optional<uint64_t>, counter_count> counters{};
+        double wall_us = 0;
+        int exit_code = 0;
+    };
+
+    struct Summary {
+        std::array<std::optional<double>, counter_count> counters{};
+        double wall_us = 0;
+        int exit_code = 0;
+    };
+
+    [[noreturn]] void usage() {
+        std::cerr << "usage: cosarch_runtime_bench --config=NAME=COMPILER[,FLAG...] [--config=...]\n"
+                     "                             [--runs=N] [--size=KB] [--workloads=lets,deep,...]\n"
+                     "                             [program.cos ...]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::string> split(const std::string &text, char separator) {
+        std::vector<std::string> parts;
+        std::stringstream stream(text);
+        for (std::string part; std::getline(stream, part, separator);) {
+            parts.push_back(part);
+        }
+        return parts;
+    }
+
+    Settings parse_settings(int argc, char *argv[]) {
+        Settings settings;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg.starts_with("--config=")) {
+                const std::string spec = arg.substr(9);
+                const size_t equals = spec.find('=');
+                if (equals == std::string::npos) {
+                    usage();
+                }
+                std::vector<std::string> parts = split(spec.substr(equals + 1), ',');
+                if (parts.empty()) {
+                    usage();
+                }
+                Config config{.name = spec.substr(0, equals),
+                              .compiler = std::filesystem::absolute(parts.front()).string(),
+                              .flags = {parts.begin() + 1, parts.end()}};
+                settings.configs.push_back(std::move(config));
+            } else if (arg.starts_with("--runs=")) {
+                settings.runs = std::max(1, std::atoi(arg.c_str() + 7));
+            } else if (arg.starts_with("--size=")) {
+                settings.kilobytes = std::max(1L, std::atol(arg.c_str() + 7));
+            } else if (arg.starts_with("--workloads=")) {
+                settings.workloads = split(arg.substr(12), ',');
+            } else if (arg.starts_with("--")) {
+                usage();
+            } else {
+                const std::filesystem::path source = std::filesystem::absolute(arg);
+                settings.programs.push_back({.name = source.stem().string(), .source = source});
+            }
+        }
+        if (settings.configs.empty()) {
+            usage();
+        }
+        return settings;
+    }
+
+    // Runs `argv` in `directory` with its output discarded; returns the
+    // exit status, or -1 when it did not exit normally.
+    int run_process(const std::vector<std::string> &argv, const std::filesystem::path &directory) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            const int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            if (chdir(directory.c_str()) != 0) {
+                _exit(127);
+            }
+            std::vector<char *> args;
+            for (const std::string &arg: argv) {
+                args.push_back(const_cast<char *>(arg.c_str()));
+            }
+            args.push_back(nullptr);
+            execv(args[0], args.data());
+            _exit(127);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+#if COSARCH_HAS_PERF
+
+    // One counter of user-space events of `pid`, started when it execs.
+    int open_counter(pid_t pid, Counter counter) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        switch (counter) {
+            case cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case branch_misses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case l1d_misses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                              PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+                break;
+            case counter_count:
+                return -1;
+        }
+        attr.disabled = 1;
+        attr.enable_on_exec = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+#endif
+
+    // Whether any counter could be opened so far; reported once.
+    bool counters_checked = false;
+
+    // Forks, attaches the counters to the child while it waits on a pipe,
+    // then lets it exec the binary and waits for it.
+    Run measure(const std::filesystem::path &binary) {
+        int gate[2];
+        if (pipe(gate) != 0) {
+            std::perror("pipe");
+            std::exit(EXIT_FAILURE);
+        }
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(gate[1]);
+            char go = 0;
+            if (read(gate[0], &go, 1) != 1) {
+                _exit(127);
+            }
+            const int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execl(binary.c_str(), binary.c_str(), nullptr);
+            _exit(127);
+        }
+        close(gate[0]);
+
+        std::array<int, counter_count> fds{};
+        fds.fill(-1);
+#if COSARCH_HAS_PERF
+        for (size_t counter = 0; counter < counter_count; ++counter) {
+            fds[counter] = open_counter(pid, static_cast<Counter>(counter));
+            if (fds[counter] < 0 && !counters_checked) {
+                std::cerr << "note: " << counter_names[counter] << " unavailable (" << std::strerror(errno) << ")"
+                          << std::endl;
+            }
+        }
+#else
+        if (!counters_checked) {
+            std::cerr << "note: no perf_event_open on this platform, reporting wall-clock time only" << std::endl;
+        }
+#endif
+        counters_checked = true;
+
+        const auto begin = std::chrono::steady_clock::now();
+        const char go = 1;
+        if (write(gate[1], &go, 1) != 1) {
+            std::perror("write");
+            std::exit(EXIT_FAILURE);
+        }
+        close(gate[1]);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        const auto end = std::chrono::steady_clock::now();
+
+        Run run;
+        run.wall_us = std::chrono::duration<double, std::micro>(end - begin).count();
+        run.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        for (size_t counter = 0; counter < counter_count; ++counter) {
+            uint64_t value = 0;
+            if (fds[counter] >= 0 && read(fds[counter], &value, sizeof(value)) == sizeof(value)) {
+                run.counters[counter] = value;
+            }
+            if (fds[counter] >= 0) {
+                close(fds[counter]);
+            }
+        }
+        return run;
+    }
+
+    double median_of(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const size_t middle = values.size() / 2;
+        return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+    }
+
+    Summary summarize(const std::vector<Run> &runs) {
+        Summary summary;
+        summary.exit_code = runs.front().exit_code;
+        std::vector<double> values;
+        for (const Run &run: runs) {
+            values.push_back(run.wall_us);
+        }
+        summary.wall_us = median_of(values);
+        for (size_t counter = 0; counter < counter_count; ++counter) {
+            values.clear();
+            for (const Run &run: runs) {
+                if (run.counters[counter].has_value()) {
+                    values.push_back(static_cast<double>(*run.counters[counter]));
+                }
+            }
+            if (values.size() == runs.size()) {
+                summary.counters[counter] = median_of(values);
+            }
+        }
+        return summary;
+    }
+
+    std::string cell(std::optional<double> value, std::optional<double> baseline) {
+        if (!value.has_value()) {
+            return "-";
+        }
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(0) << *value;
+        if (baseline.has_value() && *baseline > 0) {
+            out << " (" << std::showpos << std::setprecision(1) << (*value - *baseline) / *baseline * 100.0 << "%)";
+        }
+        return out.str();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Settings settings = parse_settings(argc, argv);
+
+    char work_template[] = "/tmp/cosarch_runtime.XXXXXX";
+    if (mkdtemp(work_template) == nullptr) {
+        std::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    const std::filesystem::path work = work_template;
+
+    if (settings.programs.empty()) {
+        for (const Workloads::Workload &workload: Workloads::all) {
+            if (!settings.workloads.empty() &&
+                std::find(settings.workloads.begin(), settings.workloads.end(), workload.name) ==
+                settings.workloads.end()) {
+                continue;
+            }
+            const std::filesystem::path source = work / (std::string(workload.name) + ".cos");
+            std::ofstream(source, std::ios::binary) << workload.generate(settings.kilobytes * 1024);
+            settings.programs.push_back({.name = std::string(workload.name), .source = source});
+        }
+    }
+
+    // binaries[config][program]
+    std::vector<std::vector<std::filesystem::path>> binaries(settings.configs.size());
+    for (size_t c = 0; c < settings.configs.size(); ++c) {
+        const Config &config = settings.configs[c];
+        const std::filesystem::path directory = work / config.name;
+        std::filesystem::create_directories(directory);
+        for (const Program &program: settings.programs) {
+            std::vector<std::string> command = {config.compiler};
+            command.insert(command.end(), config.flags.begin(), config.flags.end());
+            command.push_back(program.source.string());
+            const std::filesystem::path binary = directory / (program.name + ".bin");
+            if (run_process(command, directory) != 0 || !std::filesystem::exists(directory / "output")) {
+                std::cerr << config.name << ": compiling " << program.source << " failed" << std::endl;
+                std::filesystem::remove_all(work);
+                return EXIT_FAILURE;
+            }
+            std::filesystem::rename(directory / "output", binary);
+            binaries[c].push_back(binary);
+        }
+    }
+
+    std::cout << settings.runs << " run(s) per binary, medians; changes relative to " << settings.configs.front().name
+              << std::endl;
+    std::cout << std::left << std::setw(10) << "program" << std::setw(8) << "config" << std::setw(6) << "exit";
+    for (const char *name: counter_names) {
+        std::cout << std::setw(24) << name;
+    }
+    std::cout << "wall us" << std::endl;
+
+    bool consistent = true;
+    for (size_t p = 0; p < settings.programs.size(); ++p) {
+        std::optional<Summary> baseline;
+        for (size_t c = 0; c < settings.configs.size(); ++c) {
+            // Interleaving would be fairer for drifting clocks, but the
+            // counters are per process and do not drift.
+            std::vector<Run> runs;
+            for (int i = 0; i < settings.runs; ++i) {
+                runs.push_back(measure(binaries[c][p]));
+            }
+            const Summary summary = summarize(runs);
+            std::cout << std::left << std::setw(10) << (c == 0 ? settings.programs[p].name : "") << std::setw(8)
+                      << settings.configs[c].name << std::setw(6) << summary.exit_code;
+            for (size_t counter = 0; counter < counter_count; ++counter) {
+                std::cout << std::setw(24) << cell(summary.counters[counter],
+                                                   baseline ? baseline->counters[counter] : std::nullopt);
+            }
+            std::cout << cell(summary.wall_us, baseline ? std::optional(baseline->wall_us) : std::nullopt)
+                      << std::endl;
+            if (baseline.has_value() && baseline->exit_code != summary.exit_code) {
+                std::cerr << settings.programs[p].name << ": " << settings.configs[c].name << " exits with "
+                          << summary.exit_code << ", " << settings.configs.front().name << " with "
+                          << baseline->exit_code << std::endl;
+                consistent = false;
+            }
+            if (!baseline.has_value()) {
+                baseline = summary;
+            }
+        }
+    }
+
+    std::filesystem::remove_all(work);
+    return consistent ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// Synthetic Cosmolang programs for the benchmarks. Every generator appends
+// self-contained chunks until the program reaches the requested size, so the
+// same shape scales from kilobytes to hundreds of megabytes. All programs
+// compile without errors at every optimisation level.
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Workloads {
+    // Small deterministic generator, so a size always yields the same program.
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : m_state(seed) {
+        }
+
+        uint64_t next(uint64_t bound) {
+            m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return (m_state >> 33) % bound;
+        }
+
+    private:
+        uint64_t m_state;
+    };
+
+    // Thousands of straight-line lets, each combining earlier variables.
+    inline std::string lets(size_t target_bytes) {
+        std::string src = "let v0 = 1;\n";
+        src.reserve(target_bytes + 128);
+        Random random(1);
+        for (size_t i = 1; src.size() < target_bytes; ++i) {
+            const std::string c = std::to_string(random.next(9) + 1);
+            src += "let v" + std::to_string(i) + " = (v" + std::to_string(random.next(i)) + " + " + c + ") * (v" +
+                   std::to_string(random.next(i)) + " - v" + std::to_string(random.next(i)) + " + " + c + ") / " +
+                   c + " + v" + std::to_string(random.next(i)) + ";\n";
+        }
+        src += "exit(v0);\n";
+        return src;
+    }
+
+    // Expressions nested `depth` parentheses deep, one per let.
+    inline std::string deep(size_t target_bytes, size_t depth = 48) {
+        static constexpr std::array<std::string_view, 4> ops = {" + ", " * ", " - ", " / "};
+        std::string src = "let d0 = 7;\n";
+        src.reserve(target_bytes + 128);
+        Random random(2);
+        for (size_t i = 1; src.size() < target_bytes; ++i) {
+            std::string expr = "d" + std::to_string(random.next(i));
+            for (size_t level = 0; level < depth; ++level) {
+                const std::string operand = std::to_string(random.next(97) + 1);
+                expr = level % 2 == 0 ? "(" + expr + std::string(ops[level % 4]) + operand + ")"
+                                      : "(" + operand + std::string(ops[level % 4]) + expr + ")";
+            }
+            src += "let d" + std::to_string(i) + " = " + expr + ";\n";
+        }
+        src += "exit(d0);\n";
+        return src;
+    }
+
+    // Scopes and `if` chains nested `depth` levels deep, shadowing the
+    // outer variable on every level.
+    inline std::string scopes(size_t target_bytes, size_t depth = 24) {
+        std::string src = "let a = 3;\n";
+        src.reserve(target_bytes + 128);
+        Random random(3);
+        while (src.size() < target_bytes) {
+            std::string indent;
+            for (size_t level = 0; level < depth; ++level) {
+                const std::string n = std::to_string(random.next(50) + 1);
+                src += indent + (level % 2 == 0 ? "{\n" : "if (a - " + n + ") {\n");
+                indent += "    ";
+                src += indent + "let a = a + " + n + ";\n";
+                src += indent + "let b = a * " + n + " / (" + n + " + 1);\n";
+            }
+            src += indent + "exit(b);\n";
+            for (size_t level = depth; level-- > 0;) {
+                indent.resize(indent.size() - 4);
+                src += indent + "}\n";
+            }
+        }
+        src += "exit(a);\n";
+        return src;
+    }
+
+    // Mostly line and block comments around a few statements.
+    inline std::string comments(size_t target_bytes) {
+        std::string src;
+        src.reserve(target_bytes + 128);
+        for (size_t i = 0; src.size() < target_bytes; ++i) {
+            const std::string n = std::to_string(i);
+            src += "// Step " + n + ": nothing below depends on this line, it only has to be skipped.\n";
+            src += "/* A longer block comment that spans several lines and mentions let, exit and if\n"
+                   "   so that keyword-looking words appear inside comments as well. The scanner\n"
+                   "   has to find the closing marker without looking at any of this. */\n";
+            if (i % 8 == 0) {
+                src += "let c" + n + " = " + n + " + 1; // trailing comment\n";
+            }
+        }
+        src += "exit(0);\n";
+        return src;
+    }
+
+    // The mix the lexer benchmark has always used: comments, lets and ifs.
+    inline std::string mixed(size_t target_bytes) {
+        std::string src;
+        src.reserve(target_bytes + 512);
+        for (size_t i = 0; src.size() < target_bytes; ++i) {
+            const std::string n = std::to_string(i);
+            const std::string name = "accumulatedValue" + n;
+            src += "// Step " + n + ": recompute the running total from the previous intermediate values.\n";
+            src += "let " + name + " = (10 - 2 * 3) / 2 + (3+(4 - 1) * 7) + " + n + ";\n";
+            src += "/* The block below only runs when the value is not one. It is kept\n"
+                   "   around so the generated program exercises a conditional exit. */\n";
+            src += "if (" + name + " - 1) {\n        exit(" + name + ");\n}\n\n";
+        }
+        return src;
+    }
+
+    struct Workload {
+        std::string_view name;
+        std::string (*generate)(size_t target_bytes);
+    };
+
+    inline constexpr std::array<Workload, 5> all = {{
+            {"lets", lets},
+            {"deep", [](size_t bytes) { return deep(bytes); }},
+            {"scopes", [](size_t bytes) { return scopes(bytes); }},
+            {"comments", comments},
+            {"mixed", mixed},
+    }};
+}
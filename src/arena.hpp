@@ -1,13 +1,41 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+// Bump allocator over a list of chunks. When the current chunk is full a new
+// one twice the size of the previous one is added, so the arena never runs
+// out and small inputs only pay for the first chunk. Chunks are kept until
+// the arena is destroyed: reset() and rewind() only move the bump pointer
+// back, so one arena can be reused for many compilations without touching
+// the global allocator again.
 class ArenaAllocator {
 public:
-    explicit ArenaAllocator(const size_t max_num_bytes)
-            : m_size{max_num_bytes}, m_buffer{new std::byte[max_num_bytes]}, m_offset{m_buffer} {
+    struct Stats {
+        size_t bytes_used = 0;      // handed out since the last reset, including padding
+        size_t bytes_reserved = 0;  // sum of all chunk sizes
+        size_t chunk_count = 0;
+        size_t high_water_mark = 0; // largest bytes_used ever reached
+    };
+
+    // Position to rewind() to. Everything allocated after mark() is released.
+    struct Marker {
+        size_t chunk;
+        size_t offset;
+        size_t bytes_before;
+    };
+
+    static constexpr size_t default_chunk_size = 64 * 1024;
+
+    explicit ArenaAllocator(const size_t first_chunk_bytes = default_chunk_size) {
+        add_chunk(std::max<size_t>(first_chunk_bytes, 1));
     }
 
     ArenaAllocator(const ArenaAllocator &) = delete;
@@ -15,27 +43,32 @@ public:
     ArenaAllocator &operator=(const ArenaAllocator &) = delete;
 
     ArenaAllocator(ArenaAllocator &&other) noexcept
-            : m_size{std::exchange(other.m_size, 0)}, m_buffer{std::exchange(other.m_buffer, nullptr)},
-              m_offset{std::exchange(other.m_offset, nullptr)} {
+            : m_chunks{std::move(other.m_chunks)}, m_current{std::exchange(other.m_current, 0)},
+              m_offset{std::exchange(other.m_offset, 0)}, m_bytes_before{std::exchange(other.m_bytes_before, 0)},
+              m_high_water_mark{std::exchange(other.m_high_water_mark, 0)} {
     }
 
     ArenaAllocator &operator=(ArenaAllocator &&other) noexcept {
-        std::swap(m_size, other.m_size);
-        std::swap(m_buffer, other.m_buffer);
+        std::swap(m_chunks, other.m_chunks);
+        std::swap(m_current, other.m_current);
         std::swap(m_offset, other.m_offset);
+        std::swap(m_bytes_before, other.m_bytes_before);
+        std::swap(m_high_water_mark, other.m_high_water_mark);
         return *this;
     }
 
     template<typename T>
     [[nodiscard]] T *alloc() {
-        size_t remaining_num_bytes = m_size - static_cast<size_t>(m_offset - m_buffer);
-        auto pointer = static_cast<void *>(m_offset);
-        const auto aligned_address = std::align(alignof(T), sizeof(T), pointer, remaining_num_bytes);
-        if (aligned_address == nullptr) {
-            throw std::bad_alloc{};
+        return static_cast<T *>(alloc_bytes(sizeof(T), alignof(T)));
+    }
+
+    // Uninitialized storage for `count` objects of type T.
+    template<typename T>
+    [[nodiscard]] T *alloc_array(const size_t count) {
+        if (count > max_array_size<T>()) {
+            throw std::bad_array_new_length{};
         }
-        m_offset = static_cast<std::byte *>(aligned_address) + sizeof(T);
-        return static_cast<T *>(aligned_address);
+        return static_cast<T *>(alloc_bytes(sizeof(T) * count, alignof(T)));
     }
 
     template<typename T, typename... Args>
@@ -44,17 +77,209 @@ public:
         return new(allocated_memory) T{std::forward<Args>(args)...};
     }
 
+    // Grows `block`, which currently spans `old_bytes`, to `new_bytes` without
+    // moving it. Only possible for the latest allocation of the current chunk.
+    [[nodiscard]] bool extend(void *block, const size_t old_bytes, const size_t new_bytes) {
+        const Chunk &chunk = m_chunks[m_current];
+        if (block == nullptr || static_cast<std::byte *>(block) + old_bytes != chunk.data + m_offset
+            || new_bytes - old_bytes > chunk.size - m_offset) {
+            return false;
+        }
+        m_offset += new_bytes - old_bytes;
+        m_high_water_mark = std::max(m_high_water_mark, bytes_used());
+        return true;
+    }
+
+    [[nodiscard]] Marker mark() const {
+        return {.chunk = m_current, .offset = m_offset, .bytes_before = m_bytes_before};
+    }
+
+    void rewind(const Marker marker) {
+        m_current = marker.chunk;
+        m_offset = marker.offset;
+        m_bytes_before = marker.bytes_before;
+    }
+
+    void reset() {
+        rewind({.chunk = 0, .offset = 0, .bytes_before = 0});
+    }
+
+    [[nodiscard]] Stats stats() const {
+        Stats stats{.bytes_used = bytes_used(), .chunk_count = m_chunks.size(),
+                    .high_water_mark = m_high_water_mark};
+        for (const Chunk &chunk: m_chunks) {
+            stats.bytes_reserved += chunk.size;
+        }
+        return stats;
+    }
+
     ~ArenaAllocator() {
         // No destructors are called for the stored objects. Thus, memory
         // leaks are possible (e.g. when storing std::vector objects or
         // other non-trivially destructable objects in the allocator).
         // Although this could be changed, it would come with additional
         // runtime overhead and therefore is not implemented.
-        delete[] m_buffer;
+        for (const Chunk &chunk: m_chunks) {
+            delete[] chunk.data;
+        }
     }
 
 private:
-    size_t m_size;
-    std::byte *m_buffer;
-    std::byte *m_offset;
+    struct Chunk {
+        std::byte *data;
+        size_t size;
+    };
+
+    template<typename T>
+    static constexpr size_t max_array_size() {
+        return static_cast<size_t>(-1) / sizeof(T);
+    }
+
+    [[nodiscard]] size_t bytes_used() const {
+        return m_bytes_before + m_offset;
+    }
+
+    void *alloc_bytes(const size_t size, const size_t alignment) {
+        if (void *memory = bump(size, alignment)) {
+            return memory;
+        }
+        // The rest of the current chunk is given up. Chunks left over from an
+        // earlier rewind() are reused before new memory is requested.
+        while (true) {
+            m_bytes_before += m_chunks[m_current].size;
+            m_offset = 0;
+            if (m_current + 1 == m_chunks.size()) {
+                add_chunk(std::max(m_chunks.back().size * 2, size + alignment));
+            }
+            m_current++;
+            if (void *memory = bump(size, alignment)) {
+                return memory;
+            }
+        }
+    }
+
+    void *bump(const size_t size, const size_t alignment) {
+        const Chunk &chunk = m_chunks[m_current];
+        size_t remaining_num_bytes = chunk.size - m_offset;
+        auto pointer = static_cast<void *>(chunk.data + m_offset);
+        const auto aligned_address = std::align(alignment, size, pointer, remaining_num_bytes);
+        if (aligned_address == nullptr) {
+            return nullptr;
+        }
+        m_offset = static_cast<size_t>(static_cast<std::byte *>(aligned_address) - chunk.data) + size;
+        m_high_water_mark = std::max(m_high_water_mark, bytes_used());
+        return aligned_address;
+    }
+
+    void add_chunk(const size_t size) {
+        m_chunks.push_back({.data = new std::byte[size], .size = size});
+    }
+
+    std::vector<Chunk> m_chunks;
+    size_t m_current = 0;
+    size_t m_offset = 0;
+    size_t m_bytes_before = 0;
+    size_t m_high_water_mark = 0;
+};
+
+// Growable array stored entirely inside an ArenaAllocator. It has no
+// destructor and never calls the global allocator itself, so it can be
+// embedded in arena-allocated AST structures. Only trivially copyable
+// element types are allowed because growing copies the elements bytewise.
+// When the array is the arena's most recent allocation it grows in place;
+// otherwise the old block is abandoned to the arena.
+template<typename T>
+class ArenaVector {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+public:
+    explicit ArenaVector(ArenaAllocator &arena) noexcept
+            : m_arena(&arena) {
+    }
+
+    void reserve(const size_t capacity) {
+        if (capacity > m_capacity) {
+            grow(capacity);
+        }
+    }
+
+    void push_back(const T &value) {
+        if (m_size == m_capacity) {
+            grow(m_size + 1);
+        }
+        m_data[m_size++] = value;
+    }
+
+    void append(std::span<const T> values) {
+        reserve(m_size + values.size());
+        if (!values.empty()) {
+            std::memcpy(m_data + m_size, values.data(), values.size_bytes());
+        }
+        m_size += values.size();
+    }
+
+    // Drops the elements from `size` onwards.
+    void truncate(const size_t size) {
+        m_size = std::min(m_size, size);
+    }
+
+    [[nodiscard]] T &operator[](const size_t index) {
+        return m_data[index];
+    }
+
+    [[nodiscard]] const T &operator[](const size_t index) const {
+        return m_data[index];
+    }
+
+    [[nodiscard]] T *data() {
+        return m_data;
+    }
+
+    [[nodiscard]] const T *data() const {
+        return m_data;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return m_size;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return m_size == 0;
+    }
+
+    [[nodiscard]] T *begin() {
+        return m_data;
+    }
+
+    [[nodiscard]] T *end() {
+        return m_data + m_size;
+    }
+
+    [[nodiscard]] const T *begin() const {
+        return m_data;
+    }
+
+    [[nodiscard]] const T *end() const {
+        return m_data + m_size;
+    }
+
+private:
+    void grow(const size_t min_capacity) {
+        const size_t capacity = std::max({min_capacity, m_capacity * 2, size_t{8}});
+        if (m_arena->extend(m_data, m_capacity * sizeof(T), capacity * sizeof(T))) {
+            m_capacity = capacity;
+            return;
+        }
+        T *data = m_arena->alloc_array<T>(capacity);
+        if (m_size != 0) {
+            std::memcpy(data, m_data, m_size * sizeof(T));
+        }
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    ArenaAllocator *m_arena;
+    T *m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
 };
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include "arena.hpp"
+#include "tokenization.hpp"
+
+// Flat AST. All nodes live in one contiguous array and refer to each other by
+// 32-bit index. Nodes are appended in post-order, so a node's last child sits
+// right before it (the rhs of a binary expression is always `index - 1`,
+// until the Optimizer rewrites nodes in place; children still always come
+// before their parents).
+// Statement lists of scopes and of the program are stored as ranges in a
+// second array. Both arrays are allocated from an arena owned by whoever
+// built the AST (normally the Parser), which has to outlive the Ast.
+
+using NodeIndex = uint32_t;
+
+enum class NodeTag : uint8_t {
+    term_int_lit,
+    term_ident,
+    bin_expr_add,
+    bin_expr_sub,
+    bin_expr_multi,
+    bin_expr_div,
+    stmt_exit,
+    stmt_let,
+    stmt_scope,
+    stmt_if
+};
+
+// Operands by tag:
+//   term_int_lit               a = low 32 bits of the value, b = high 32 bits
+//   term_ident                 a = interned id, b = token offset
+//   bin_expr_*                 a = lhs, b = rhs
+//   stmt_exit                  a = expr
+//   stmt_let                   a = expr, b = interned id, c = token offset
+//   stmt_scope                 a = first list slot, b = statement count
+//   stmt_if                    a = expr, b = scope
+struct AstNode {
+    NodeTag tag;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+static_assert(sizeof(AstNode) == 16);
+
+// Typed views handed to visitors. They are decoded from an AstNode on the
+// fly and are only valid as long as the Ast they came from.
+struct NodeTermIntLit {
+    uint64_t value;
+};
+
+struct NodeTermIdent {
+    IdentId ident;
+    uint32_t offset;
+};
+
+struct NodeBinExprAdd {
+    NodeIndex lhs;
+    NodeIndex rhs;
+};
+
+struct NodeBinExprSub {
+    NodeIndex lhs;
+    NodeIndex rhs;
+};
+
+struct NodeBinExprMulti {
+    NodeIndex lhs;
+    NodeIndex rhs;
+};
+
+struct NodeBinExprDiv {
+    NodeIndex lhs;
+    NodeIndex rhs;
+};
+
+struct NodeStmtExit {
+    NodeIndex expr;
+};
+
+struct NodeStmtLet {
+    IdentId ident;
+    uint32_t offset;
+    NodeIndex expr;
+};
+
+struct NodeScope {
+    std::span<const NodeIndex> stmts;
+};
+
+struct NodeStmtIf {
+    NodeIndex expr;
+    NodeIndex scope;
+};
+
+class Ast {
+public:
+    inline explicit Ast(ArenaAllocator &arena)
+            : m_nodes(arena), m_lists(arena) {
+    }
+
+    inline NodeIndex add(const AstNode &node) {
+        m_nodes.push_back(node);
+        return static_cast<NodeIndex>(m_nodes.size() - 1);
+    }
+
+    // Appends a statement list and returns its first slot.
+    inline uint32_t add_list(std::span<const NodeIndex> stmts) {
+        const auto first = static_cast<uint32_t>(m_lists.size());
+        m_lists.append(stmts);
+        return first;
+    }
+
+    inline void set_prog(uint32_t first, uint32_t count) {
+        m_prog_first = first;
+        m_prog_count = count;
+    }
+
+    inline NodeIndex add_int_lit(uint64_t value) {
+        return add(int_lit_node(value));
+    }
+
+    // Overwrites node `index`. Used by passes that simplify the tree in
+    // place; the replacement may only refer to nodes before `index`.
+    inline void replace(NodeIndex index, const AstNode &node) {
+        m_nodes[index] = node;
+    }
+
+    [[nodiscard]] static inline AstNode int_lit_node(uint64_t value) {
+        return {.tag = NodeTag::term_int_lit, .a = static_cast<uint32_t>(value),
+                .b = static_cast<uint32_t>(value >> 32)};
+    }
+
+    [[nodiscard]] static inline uint64_t int_lit_value(const AstNode &node) {
+        return static_cast<uint64_t>(node.b) << 32 | node.a;
+    }
+
+    [[nodiscard]] inline const AstNode &node(NodeIndex index) const {
+        return m_nodes[index];
+    }
+
+    [[nodiscard]] inline size_t size() const {
+        return m_nodes.size();
+    }
+
+    // Every statement spans at least two tokens, so a program of `num_tokens`
+    // tokens has at most `num_tokens` nodes and `num_tokens / 2` list slots.
+    inline void reserve_for_tokens(size_t num_tokens) {
+        m_nodes.reserve(num_tokens);
+        m_lists.reserve(num_tokens / 2);
+    }
+
+    static constexpr size_t bytes_for_tokens(size_t num_tokens) {
+        return num_tokens * sizeof(AstNode) + num_tokens / 2 * sizeof(NodeIndex);
+    }
+
+    [[nodiscard]] inline std::span<const NodeIndex> prog() const {
+        return list(m_prog_first, m_prog_count);
+    }
+
+    [[nodiscard]] inline NodeScope scope(NodeIndex index) const {
+        const AstNode &node = m_nodes[index];
+        return {.stmts = list(node.a, node.b)};
+    }
+
+    // Calls `visitor` with the typed view of expression node `index`.
+    template<typename Visitor>
+    decltype(auto) visit_expr(NodeIndex index, Visitor &&visitor) const {
+        const AstNode &node = m_nodes[index];
+        switch (node.tag) {
+            case NodeTag::term_int_lit:
+                return visitor(NodeTermIntLit{.value = int_lit_value(node)});
+            case NodeTag::term_ident:
+                return visitor(NodeTermIdent{.ident = node.a, .offset = node.b});
+            case NodeTag::bin_expr_add:
+                return visitor(NodeBinExprAdd{.lhs = node.a, .rhs = node.b});
+            case NodeTag::bin_expr_sub:
+                return visitor(NodeBinExprSub{.lhs = node.a, .rhs = node.b});
+            case NodeTag::bin_expr_multi:
+                return visitor(NodeBinExprMulti{.lhs = node.a, .rhs = node.b});
+            case NodeTag::bin_expr_div:
+                return visitor(NodeBinExprDiv{.lhs = node.a, .rhs = node.b});
+            default:
+                std::unreachable();
+        }
+    }
+
+    // Calls `visitor` with the typed view of statement node `index`.
+    template<typename Visitor>
+    decltype(auto) visit_stmt(NodeIndex index, Visitor &&visitor) const {
+        const AstNode &node = m_nodes[index];
+        switch (node.tag) {
+            case NodeTag::stmt_exit:
+                return visitor(NodeStmtExit{.expr = node.a});
+            case NodeTag::stmt_let:
+                return visitor(NodeStmtLet{.ident = node.b, .offset = node.c, .expr = node.a});
+            case NodeTag::stmt_scope:
+                return visitor(scope(index));
+            case NodeTag::stmt_if:
+                return visitor(NodeStmtIf{.expr = node.a, .scope = node.b});
+            default:
+                std::unreachable();
+        }
+    }
+
+private:
+    [[nodiscard]] inline std::span<const NodeIndex> list(uint32_t first, uint32_t count) const {
+        return {m_lists.data() + first, count};
+    }
+
+    ArenaVector<AstNode> m_nodes;
+    ArenaVector<NodeIndex> m_lists;
+    uint32_t m_prog_first = 0;
+    uint32_t m_prog_count = 0;
+};
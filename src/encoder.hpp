@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "instruction.hpp"
+#include "utils/log.hpp"
+
+// Encodes the generator's instruction list into x86-64 machine code, so the
+// built-in backend needs neither nasm nor ld. Only the opcode and operand
+// forms the generator emits are supported. Encodings follow what nasm picks
+// with its default optimisation: `mov r64, imm` uses the zero-extending
+// 32-bit form where it can, immediates use the imm8 forms where they fit
+// and jumps are short whenever the target is within reach.
+class X86Encoder {
+public:
+    // Machine code for `code`, to be loaded at any address (all jumps are
+    // relative).
+    [[nodiscard]] std::vector<uint8_t> encode(std::span<const Instr> code) {
+        // Jumps start out short and are widened until every displacement
+        // fits. Widening only ever moves labels further apart, so this ends.
+        m_long_jump.assign(code.size(), 0);
+        bool changed = true;
+        while (changed) {
+            layout(code);
+            changed = false;
+            for (size_t i = 0; i < code.size(); ++i) {
+                if (is_jump(code[i].op) && !m_long_jump[i] && !fits_int8(displacement(code, i))) {
+                    m_long_jump[i] = 1;
+                    changed = true;
+                }
+            }
+        }
+
+        m_out.clear();
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instr &instr = code[i];
+            if (is_jump(instr.op)) {
+                encode_jump(instr, m_long_jump[i], displacement(code, i));
+            } else {
+                encode(instr);
+            }
+        }
+        return std::move(m_out);
+    }
+
+private:
+    static inline bool is_jump(Opcode op) {
+        return op == Opcode::jz || op == Opcode::jmp;
+    }
+
+    static inline bool fits_int8(int64_t value) {
+        return value >= INT8_MIN && value <= INT8_MAX;
+    }
+
+    static inline bool fits_int32(uint64_t value) {
+        return static_cast<int64_t>(value) >= INT32_MIN && static_cast<int64_t>(value) <= INT32_MAX;
+    }
+
+    static inline uint8_t code_of(Reg reg) {
+        return static_cast<uint8_t>(reg);
+    }
+
+    // Offsets of every instruction and label for the current jump sizes.
+    void layout(std::span<const Instr> code) {
+        m_offsets.assign(code.size() + 1, 0);
+        m_label_offsets.clear();
+        size_t offset = 0;
+        for (size_t i = 0; i < code.size(); ++i) {
+            m_offsets[i] = offset;
+            const Instr &instr = code[i];
+            if (instr.op == Opcode::label) {
+                if (instr.label >= m_label_offsets.size()) {
+                    m_label_offsets.resize(instr.label + 1, 0);
+                }
+                m_label_offsets[instr.label] = offset;
+            } else if (is_jump(instr.op)) {
+                offset += jump_size(instr.op, m_long_jump[i]);
+            } else {
+                m_out.clear();
+                encode(instr);
+                offset += m_out.size();
+            }
+        }
+        m_offsets[code.size()] = offset;
+    }
+
+    static inline size_t jump_size(Opcode op, bool is_long) {
+        if (!is_long) {
+            return 2;
+        }
+        return op == Opcode::jz ? 6 : 5;
+    }
+
+    // Distance from the end of jump `index` to its label.
+    [[nodiscard]] int64_t displacement(std::span<const Instr> code, size_t index) const {
+        const uint32_t label = code[index].label;
+        if (label >= m_label_offsets.size()) {
+            Log::error(7770, "Label: " + label_name(label));
+        }
+        const size_t end = m_offsets[index] + jump_size(code[index].op, m_long_jump[index]);
+        return static_cast<int64_t>(m_label_offsets[label]) - static_cast<int64_t>(end);
+    }
+
+    void encode_jump(const Instr &instr, bool is_long, int64_t disp) {
+        if (!is_long) {
+            byte(instr.op == Opcode::jz ? 0x74 : 0xEB);
+            byte(static_cast<uint8_t>(disp));
+            return;
+        }
+        if (instr.op == Opcode::jz) {
+            byte(0x0F);
+            byte(0x84);
+        } else {
+            byte(0xE9);
+        }
+        imm32(static_cast<uint32_t>(disp));
+    }
+
+    void encode(const Instr &instr) {
+        const Operand &dst = instr.dst;
+        const Operand &src = instr.src;
+        switch (instr.op) {
+            case Opcode::mov:
+                encode_mov(dst, src);
+                return;
+            case Opcode::add:
+                encode_alu(0x01, 0x03, 0, dst, src);
+                return;
+            case Opcode::sub:
+                encode_alu(0x29, 0x2B, 5, dst, src);
+                return;
+            case Opcode::xor_:
+                encode_alu(0x31, 0x33, 6, dst, src);
+                return;
+            case Opcode::imul:
+                if (src.kind == Operand::Kind::imm) {
+                    const bool short_imm = fits_int8(static_cast<int64_t>(src.imm));
+                    rm_instr({short_imm ? uint8_t{0x6B} : uint8_t{0x69}}, code_of(dst.reg), dst, true);
+                    short_imm ? byte(static_cast<uint8_t>(src.imm)) : imm32(static_cast<uint32_t>(src.imm));
+                } else {
+                    rm_instr({0x0F, 0xAF}, code_of(dst.reg), src, true);
+                }
+                return;
+            case Opcode::mul:
+                rm_instr({0xF7}, 4, dst, true);
+                return;
+            case Opcode::div:
+                rm_instr({0xF7}, 6, dst, true);
+                return;
+            case Opcode::shl:
+            case Opcode::shr: {
+                const uint8_t ext = instr.op == Opcode::shl ? 4 : 5;
+                if (src.imm == 1) {
+                    rm_instr({0xD1}, ext, dst, true);
+                } else {
+                    rm_instr({0xC1}, ext, dst, true);
+                    byte(static_cast<uint8_t>(src.imm));
+                }
+                return;
+            }
+            case Opcode::lea:
+                rm_instr({0x8D}, code_of(dst.reg), src, true);
+                return;
+            case Opcode::test:
+                rm_instr({0x85}, code_of(src.reg), dst, true);
+                return;
+            case Opcode::push:
+            case Opcode::pop:
+                if (code_of(dst.reg) >= 8) {
+                    byte(0x41);
+                }
+                byte(static_cast<uint8_t>((instr.op == Opcode::push ? 0x50 : 0x58) + (code_of(dst.reg) & 7)));
+                return;
+            case Opcode::syscall:
+                byte(0x0F);
+                byte(0x05);
+                return;
+            case Opcode::label:
+                return;
+            case Opcode::jz:
+            case Opcode::jmp:
+                break;
+        }
+        Log::error(7770, "Opcode: " + std::string(opcode_names[static_cast<size_t>(instr.op)]));
+    }
+
+    void encode_mov(const Operand &dst, const Operand &src) {
+        if (src.kind == Operand::Kind::imm) {
+            if (dst.kind == Operand::Kind::reg && src.imm <= UINT32_MAX) {
+                // mov r32, imm32 clears the upper half.
+                if (code_of(dst.reg) >= 8) {
+                    byte(0x41);
+                }
+                byte(static_cast<uint8_t>(0xB8 + (code_of(dst.reg) & 7)));
+                imm32(static_cast<uint32_t>(src.imm));
+            } else if (fits_int32(src.imm)) {
+                rm_instr({0xC7}, 0, dst, true);
+                imm32(static_cast<uint32_t>(src.imm));
+            } else if (dst.kind != Operand::Kind::reg) {
+                Log::error(7770, "mov to memory with a 64-bit immediate");
+            } else {
+                byte(static_cast<uint8_t>(0x48 | (code_of(dst.reg) >> 3)));
+                byte(static_cast<uint8_t>(0xB8 + (code_of(dst.reg) & 7)));
+                imm32(static_cast<uint32_t>(src.imm));
+                imm32(static_cast<uint32_t>(src.imm >> 32));
+            }
+        } else if (src.kind == Operand::Kind::reg) {
+            rm_instr({0x89}, code_of(src.reg), dst, true);
+        } else {
+            rm_instr({0x8B}, code_of(dst.reg), src, true);
+        }
+    }
+
+    // add, sub and xor: `op r/m, r` (`mr`), `op r, m` (`rm`) or the group-1
+    // immediate forms with extension `ext`.
+    void encode_alu(uint8_t mr, uint8_t rm, uint8_t ext, const Operand &dst, const Operand &src) {
+        const bool wide = !dst.dword;
+        if (src.kind == Operand::Kind::imm) {
+            const bool short_imm = fits_int8(static_cast<int64_t>(src.imm));
+            rm_instr({short_imm ? uint8_t{0x83} : uint8_t{0x81}}, ext, dst, wide);
+            short_imm ? byte(static_cast<uint8_t>(src.imm)) : imm32(static_cast<uint32_t>(src.imm));
+        } else if (src.kind == Operand::Kind::reg) {
+            rm_instr({mr}, code_of(src.reg), dst, wide);
+        } else {
+            rm_instr({rm}, code_of(dst.reg), src, wide);
+        }
+    }
+
+    // REX prefix, opcode bytes and ModRM (plus SIB and displacement) for an
+    // instruction with register field `reg` and r/m operand `rm`.
+    void rm_instr(std::initializer_list<uint8_t> opcode, uint8_t reg, const Operand &rm, bool wide) {
+        uint8_t base = 0;
+        uint8_t index = 0;
+        if (rm.kind == Operand::Kind::reg) {
+            base = code_of(rm.reg);
+        } else if (rm.kind == Operand::Kind::stack) {
+            base = code_of(Reg::rsp);
+        } else if (rm.kind == Operand::Kind::address) {
+            base = code_of(rm.reg);
+            index = code_of(rm.index);
+        } else {
+            Log::error(7770, "Operand kind");
+        }
+        const uint8_t rex = static_cast<uint8_t>((wide ? 0x08 : 0) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+        if (rex != 0) {
+            byte(static_cast<uint8_t>(0x40 | rex));
+        }
+        for (const uint8_t op: opcode) {
+            byte(op);
+        }
+
+        if (rm.kind == Operand::Kind::reg) {
+            byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (base & 7)));
+            return;
+        }
+        // Memory operands always go through a SIB byte. [rbp]/[r13] as base
+        // have no mod 00 form and take a zero disp8 instead.
+        const uint32_t disp = rm.kind == Operand::Kind::stack ? rm.disp : 0;
+        uint8_t mod = 0;
+        if (disp > 127) {
+            mod = 2;
+        } else if (disp != 0 || (base & 7) == 5) {
+            mod = 1;
+        }
+        byte(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | 4));
+        uint8_t scale_bits = 0;
+        if (rm.kind == Operand::Kind::address) {
+            scale_bits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+        } else {
+            index = code_of(Reg::rsp); // no index
+        }
+        byte(static_cast<uint8_t>((scale_bits << 6) | ((index & 7) << 3) | (base & 7)));
+        if (mod == 1) {
+            byte(static_cast<uint8_t>(disp));
+        } else if (mod == 2) {
+            imm32(disp);
+        }
+    }
+
+    void byte(uint8_t value) {
+        m_out.push_back(value);
+    }
+
+    void imm32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    std::vector<uint8_t> m_out;
+    std::vector<size_t> m_offsets;
+    std::vector<size_t> m_label_offsets;
+    std::vector<uint8_t> m_long_jump;
+};
@@ -1,228 +1,274 @@
 #pragma once
 
-#include "parser.hpp"
-#include <cassert>
-
+#include "instruction.hpp"
+#include "ir.hpp"
+#include "linear_scan.hpp"
+#include "utils/div_magic.hpp"
+#include "utils/log.hpp"
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lowers the IR to x86-64 instructions. Values live where LinearScan put
+// them; spilled ones get a slot in a frame reserved once at program start.
+// rax and rdx are never allocated and serve as scratch registers: rax for
+// results that go to memory and as div's dividend, rdx for div and for
+// immediates that do not fit an imm32 operand.
+//
+// Multiplication by a constant becomes shl and/or lea where the constant is
+// 2^k times 1, 3, 5 or 9, and division by a constant becomes shr or a
+// multiplication by its magic number (see div_magic.hpp), at every -O level:
+// from -O1 the optimizers fold such arithmetic away, so -O0 is where it
+// applies. Arithmetic is unsigned 64-bit throughout, so the remaining
+// divisions clear rdx and use div.
 class Generator {
 public:
-    inline explicit Generator(NodeProg prog)
-            : m_prog(std::move(prog)) {
-    }
-
-    void gen_term(const NodeTerm *term) {
-        struct TermVisitor {
-            Generator *gen;
-
-            void operator()(const NodeTermIntLit *term_int_lit) const {
-                gen->m_output << "\tmov rax, " << term_int_lit->int_lit.value.value() << "\n";
-                gen->push("rax");
-                Log::addProcess("Integer Literal: " + term_int_lit->int_lit.value.value());
-            }
-
-            void operator()(const NodeTermIdent *term_ident) const {
-                auto it = std::ranges::find_if(gen->m_vars.cbegin(), gen->m_vars.cend(), [&](const Var &var) {
-                    return var.name == term_ident->ident.value.value();
-                });
-                if (it == gen->m_vars.cend()) {
-                    Log::error(4570, "Identifier: " + term_ident->ident.value.value());
-                }
-                std::stringstream offset;
-                offset << "QWORD [rsp + " << (gen->m_stack_size - it->stack_loc - 1) * 8 << "]";
-                gen->push(offset.str());
-
-                Log::addProcess("Identifier: " + term_ident->ident.value.value());
-            }
-
-            void operator()(const NodeTermParen *term_paren) const {
-                gen->gen_expr(term_paren->expr);
-            }
-        };
-        TermVisitor visitor({.gen = this});
-        std::visit(visitor, term->var);
+    // `num_regs` limits the register pool (1 forces almost every value into
+    // the frame).
+    inline explicit Generator(const IrProgram &program, size_t num_regs = allocatable_regs.size())
+            : m_program(program), m_allocation(LinearScan(num_regs).run(program)),
+              m_has_label(program.blocks.size(), 0) {
     }
 
-    void gen_bin_expr(const NodeBinExpr *bin_expr) {
-        struct BinExprVisitor {
-            Generator *gen;
-
-            void operator()(const NodeBinExprAdd *add) const {
-                gen->gen_expr(add->rhs);
-                gen->gen_expr(add->lhs);
-                gen->pop("rax");
-                gen->pop("rbx");
-                gen->m_output << "\tadd rax, rbx\n";
-                gen->push("rax");
-                Log::addProcess("Addition with RAX and RBX in " + std::to_string(add->lhs->var.index()) + " and " +
-                                std::to_string(add->rhs->var.index()));
-            }
-
-            void operator()(const NodeBinExprSub *sub) const {
-                gen->gen_expr(sub->rhs);
-                gen->gen_expr(sub->lhs);
-                gen->pop("rax");
-                gen->pop("rbx");
-                gen->m_output << "\tsub rax, rbx\n";
-                gen->push("rax");
-                Log::addProcess("Subtraction with RAX and RBX in " + std::to_string(sub->lhs->var.index()) + " and " +
-                                std::to_string(sub->rhs->var.index()));
-            }
-
-
-            void operator()(const NodeBinExprMulti *multi) const {
-                gen->gen_expr(multi->rhs);
-                gen->gen_expr(multi->lhs);
-                gen->pop("rax");
-                gen->pop("rbx");
-                gen->m_output << "\tmul rbx\n";
-                gen->push("rax");
-                Log::addProcess(
-                        "Multiplication with RAX and RBX in " + std::to_string(multi->lhs->var.index()) + " and " +
-                        std::to_string(multi->rhs->var.index()));
-            }
-
-            void operator()(const NodeBinExprDiv *div) const {
-                gen->gen_expr(div->rhs);
-                gen->gen_expr(div->lhs);
-                gen->pop("rax");
-                gen->pop("rbx");
-                gen->m_output << "\tdiv rbx\n";
-                gen->push("rax");
-                Log::addProcess("Division with RAX and RBX in " + std::to_string(div->lhs->var.index()) + " and " +
-                                std::to_string(div->rhs->var.index()));
+    // Code of the whole program. print_asm() turns it into NASM source.
+    [[nodiscard]] std::vector<Instr> gen_prog() {
+        Log::addProcess("Register allocation: ", m_allocation.num_spilled, " value(s) spilled to ",
+                        m_allocation.num_slots, " stack slot(s)");
+        if (m_allocation.num_slots != 0) {
+            emit({.op = Opcode::sub, .dst = reg_operand(Reg::rsp),
+                  .src = imm_operand(uint64_t{m_allocation.num_slots} * 8)});
+        }
+        for (BlockId id = 0; id < m_program.blocks.size(); ++id) {
+            const IrBlock &block = m_program.blocks[id];
+            if (m_has_label[id]) {
+                emit({.op = Opcode::label, .label = id});
             }
-        };
-
-        BinExprVisitor visitor{.gen = this};
-        std::visit(visitor, bin_expr->var);
-    }
-
-    void gen_expr(const NodeExpr *expr) {
-        struct ExprVisitor {
-            Generator *gen;
-
-            void operator()(const NodeTerm *term) const {
-                gen->gen_term(term);
+            for (const IrInst &inst: block.insts) {
+                gen_inst(inst);
             }
-
-            void operator()(const NodeBinExpr *bin_expr) const {
-                gen->gen_bin_expr(bin_expr);
-            }
-        };
-
-        ExprVisitor visitor{.gen = this};
-        std::visit(visitor, expr->var);
+            gen_term(id, block.term);
+        }
+        return std::move(m_code);
     }
 
-    void gen_scope(const NodeScope *scope) {
-        begin_scope();
-        for (const NodeStmt *stmt: scope->stmts) {
-            gen_stmt(stmt);
+    void gen_inst(const IrInst &inst) {
+        const Operand dst = location(inst.dst);
+        switch (inst.op) {
+            case IrOp::div:
+                if (inst.rhs.is_imm) {
+                    gen_div_by_constant(dst, inst.lhs, inst.rhs.imm);
+                } else {
+                    gen_div(dst, inst.lhs, inst.rhs);
+                }
+                break;
+            case IrOp::mul:
+                if (inst.lhs.is_imm || inst.rhs.is_imm) {
+                    const bool rhs_is_imm = inst.rhs.is_imm;
+                    gen_mul_by_constant(inst, dst, rhs_is_imm ? inst.lhs : inst.rhs,
+                                        rhs_is_imm ? inst.rhs.imm : inst.lhs.imm);
+                } else {
+                    gen_two_address(inst, dst);
+                }
+                break;
+            case IrOp::add:
+            case IrOp::sub:
+                gen_two_address(inst, dst);
+                break;
         }
-        end_scope();
-        Log::addProcess("Scope");
     }
 
-    void gen_stmt(const NodeStmt *stmt) {
-        struct StmtVisitor {
-            Generator *gen;
-
-            void operator()(const NodeStmtExit *stmt_exit) const {
-                gen->gen_expr(stmt_exit->expr);
-                gen->m_output << "\tmov rax, 60\n";
-                gen->pop("rdi");
-                gen->m_output << "\tsyscall\n";
+    void gen_term(BlockId id, const Terminator &term) {
+        switch (term.kind) {
+            case TermKind::exit:
+                move(reg_operand(Reg::rdi), term.arg);
+                emit({.op = Opcode::mov, .dst = reg_operand(Reg::rax), .src = imm_operand(60)});
+                emit({.op = Opcode::syscall});
                 Log::addProcess("Exit with RDI");
-            }
-
-            void operator()(const NodeStmtLet *stmt_let) const {
-                auto it = std::ranges::find_if(gen->m_vars.cbegin(), gen->m_vars.cend(), [&](const Var &var) {
-                    return var.name == stmt_let->ident.value.value();
-                });
-                if (it != gen->m_vars.cend()) {
-                    Log::error(4571, "Identifier: " + stmt_let->ident.value.value());
+                break;
+            case TermKind::jump:
+                jump(id, term.target);
+                break;
+            case TermKind::branch: {
+                if (term.arg.is_imm) {
+                    jump(id, term.arg.imm != 0 ? term.target : term.other);
+                    break;
                 }
-
-                gen->m_vars.push_back({.name = stmt_let->ident.value.value(), .stack_loc = gen->m_stack_size});
-                gen->gen_expr(stmt_let->expr);
-                Log::addProcess("Let Identifier: " + stmt_let->ident.value.value());
-            }
-
-            void operator()(const NodeScope *scope) const {
-                gen->gen_scope(scope);
+                Operand cond = location(term.arg.value);
+                if (cond.kind != Operand::Kind::reg) {
+                    emit({.op = Opcode::mov, .dst = reg_operand(Reg::rax), .src = cond});
+                    cond = reg_operand(Reg::rax);
+                }
+                emit({.op = Opcode::test, .dst = cond, .src = cond});
+                emit({.op = Opcode::jz, .label = term.other});
+                m_has_label[term.other] = 1;
+                jump(id, term.target);
+                break;
             }
+        }
+    }
 
-            void operator()(const NodeStmtIf *stmt_if) const {
-                gen->gen_expr(stmt_if->expr);
-                gen->pop("rax");
-                std::string label = gen->create_label();
-                gen->m_output << "\ttest rax, rax\n";
-                gen->m_output << "\tjz " << label << "\n";
-                gen->gen_scope(stmt_if->scope);
-                gen->m_output << label << ":\n";
+private:
+    // Immediates above this need a register; x86-64 sign-extends imm32.
+    static constexpr uint64_t max_imm = INT32_MAX;
 
-                Log::addProcess("If Statement of " + std::to_string(stmt_if->expr->var.index()));
-            }
-        };
+    [[nodiscard]] Operand location(ValueId value) const {
+        const Location &location = m_allocation.locations[value];
+        if (location.in_register) {
+            return reg_operand(location.reg);
+        }
+        return stack_operand(location.slot * 8);
+    }
 
-        StmtVisitor visitor{.gen = this};
-        std::visit(visitor, stmt->var);
+    [[nodiscard]] Operand operand(const IrArg &arg) const {
+        return arg.is_imm ? imm_operand(arg.imm) : location(arg.value);
     }
 
-    [[nodiscard]] std::string gen_prog() {
-        m_output << "global _start\n_start:\n";
+    // dst = lhs / rhs with div, which works on rdx:rax; both stay out of the
+    // pool. An immediate divisor goes through the stack, as div has no
+    // immediate form and no other register is free.
+    void gen_div(const Operand &dst, const IrArg &lhs, const IrArg &rhs) {
+        move(reg_operand(Reg::rax), lhs);
+        if (rhs.is_imm) {
+            emit({.op = Opcode::mov, .dst = reg_operand(Reg::rdx), .src = imm_operand(rhs.imm)});
+            emit({.op = Opcode::push, .dst = reg_operand(Reg::rdx)});
+            emit(zero(Reg::rdx));
+            emit({.op = Opcode::div, .dst = stack_operand(0)});
+            emit({.op = Opcode::add, .dst = reg_operand(Reg::rsp), .src = imm_operand(8)});
+        } else {
+            emit(zero(Reg::rdx));
+            emit({.op = Opcode::div, .dst = operand(rhs)});
+        }
+        emit({.op = Opcode::mov, .dst = dst, .src = reg_operand(Reg::rax)});
+    }
 
-        for (const NodeStmt *stmt: m_prog.stmts) {
-            gen_stmt(stmt);
+    void gen_div_by_constant(const Operand &dst, const IrArg &lhs, uint64_t divisor) {
+        if (divisor == 0) {
+            // Keep the division so the program still traps.
+            move(reg_operand(Reg::rax), lhs);
+            emit(zero(Reg::rdx));
+            emit({.op = Opcode::div, .dst = reg_operand(Reg::rdx)});
+            return;
+        }
+        if (lhs.is_imm) {
+            move(dst, IrArg::constant(lhs.imm / divisor));
+            return;
+        }
+        if (divisor == 1) {
+            move(dst, lhs);
+            return;
         }
+        if (std::has_single_bit(divisor)) {
+            const Reg target = dst.kind == Operand::Kind::reg ? dst.reg : Reg::rax;
+            move(reg_operand(target), lhs);
+            emit({.op = Opcode::shr, .dst = reg_operand(target), .src = imm_operand(std::countr_zero(divisor))});
+            store(dst, target);
+            return;
+        }
+        const DivMagic magic = unsigned_div_magic(divisor);
+        emit({.op = Opcode::mov, .dst = reg_operand(Reg::rax), .src = imm_operand(magic.multiplier)});
+        emit({.op = Opcode::mul, .dst = operand(lhs)});
+        Reg result = Reg::rdx;
+        if (magic.add) {
+            move(reg_operand(Reg::rax), lhs);
+            emit({.op = Opcode::sub, .dst = reg_operand(Reg::rax), .src = reg_operand(Reg::rdx)});
+            emit({.op = Opcode::shr, .dst = reg_operand(Reg::rax), .src = imm_operand(1)});
+            emit({.op = Opcode::add, .dst = reg_operand(Reg::rax), .src = reg_operand(Reg::rdx)});
+            result = Reg::rax;
+        }
+        if (magic.shift != 0) {
+            emit({.op = Opcode::shr, .dst = reg_operand(result), .src = imm_operand(magic.shift)});
+        }
+        store(dst, result);
+    }
 
-        m_output << "\tmov rax, 60\n";
-        m_output << "\tmov rdi, 0\n";
-        m_output << "\tsyscall\n";
-        return m_output.str();
+    void gen_mul_by_constant(const IrInst &inst, const Operand &dst, const IrArg &value, uint64_t factor) {
+        if (factor == 0 || factor == 1) {
+            move(dst, factor == 0 ? IrArg::constant(0) : value);
+            return;
+        }
+        const int shift = std::countr_zero(factor);
+        const uint64_t odd = factor >> shift;
+        if (odd != 1 && odd != 3 && odd != 5 && odd != 9) {
+            gen_two_address(inst, dst);
+            return;
+        }
+        const Reg target = dst.kind == Operand::Kind::reg ? dst.reg : Reg::rax;
+        move(reg_operand(target), value);
+        if (odd != 1) {
+            emit({.op = Opcode::lea, .dst = reg_operand(target),
+                  .src = address_operand(target, target, static_cast<uint8_t>(odd - 1))});
+        }
+        if (shift != 0) {
+            emit({.op = Opcode::shl, .dst = reg_operand(target), .src = imm_operand(shift)});
+        }
+        store(dst, target);
     }
 
-private:
-    void push(const std::string &reg) {
-        m_output << "\tpush " << reg << "\n";
-        m_stack_size++;
-        Log::addProcess("Stack Size: " + std::to_string(m_stack_size) + " Register: " + reg);
+    void store(const Operand &dst, Reg reg) {
+        if (!dst.is_reg(reg)) {
+            emit({.op = Opcode::mov, .dst = dst, .src = reg_operand(reg)});
+        }
     }
 
-    void pop(const std::string &reg) {
-        m_output << "\tpop " << reg << "\n";
-        m_stack_size--;
-        Log::addProcess("Stack Size: " + std::to_string(m_stack_size) + " Register: " + reg);
+    // dst = lhs op rhs with x86's two-address `op dst, src`.
+    void gen_two_address(const IrInst &inst, const Operand &dst) {
+        static constexpr Opcode opcodes[] = {Opcode::add, Opcode::sub, Opcode::imul};
+        const Opcode op = opcodes[static_cast<size_t>(inst.op)];
+        IrArg lhs = inst.lhs;
+        IrArg rhs = inst.rhs;
+        Reg target = dst.kind == Operand::Kind::reg ? dst.reg : Reg::rax;
+        // Loading lhs into the target would overwrite rhs.
+        if (!rhs.is_imm && !(!lhs.is_imm && lhs.value == rhs.value) && location(rhs.value).is_reg(target)) {
+            if (inst.op == IrOp::sub) {
+                target = Reg::rax;
+            } else {
+                std::swap(lhs, rhs);
+            }
+        }
+        Operand src = operand(rhs);
+        if (src.kind == Operand::Kind::imm && src.imm > max_imm) {
+            emit({.op = Opcode::mov, .dst = reg_operand(Reg::rdx), .src = src});
+            src = reg_operand(Reg::rdx);
+        }
+        move(reg_operand(target), lhs);
+        emit({.op = op, .dst = reg_operand(target), .src = src});
+        store(dst, target);
     }
 
-    void begin_scope() {
-        m_scopes.push_back(m_vars.size());
-        Log::addProcess("Scope Size: " + std::to_string(m_vars.size()) + ". Begin Scope.");
+    // mov dst, arg, going through rax for memory-to-memory moves and wide
+    // immediates stored to memory.
+    void move(const Operand &dst, const IrArg &arg) {
+        const Operand src = operand(arg);
+        if (src == dst) {
+            return;
+        }
+        const bool needs_scratch = dst.kind == Operand::Kind::stack
+                                   && (src.kind == Operand::Kind::stack
+                                       || (src.kind == Operand::Kind::imm && src.imm > max_imm));
+        if (needs_scratch) {
+            emit({.op = Opcode::mov, .dst = reg_operand(Reg::rax), .src = src});
+            emit({.op = Opcode::mov, .dst = dst, .src = reg_operand(Reg::rax)});
+        } else {
+            emit({.op = Opcode::mov, .dst = dst, .src = src});
+        }
     }
 
-    void end_scope() {
-        size_t scope_size = m_vars.size() - m_scopes.back();
-        m_output << "\tadd rsp, " << scope_size * 8 << "\n";
-        m_stack_size -= scope_size;
-        //m_vars.resize(m_scopes.back());
-        for (int i = 0; i < scope_size; i++) {
-            m_vars.pop_back();
+    // Control transfer from the end of block `from`; falling through to the
+    // next block needs no instruction.
+    void jump(BlockId from, BlockId target) {
+        if (target != from + 1) {
+            emit({.op = Opcode::jmp, .label = target});
+            m_has_label[target] = 1;
         }
-        m_scopes.pop_back();
-        Log::addProcess("Scope Size: " + std::to_string(m_vars.size()) + ". End Scope.");
     }
 
-    std::string create_label() {
-        return ".L" + std::to_string(m_label_count++);
+    void emit(const Instr &instr) {
+        m_code.push_back(instr);
     }
 
-    struct Var {
-        std::string name;
-        size_t stack_loc;
-    };
-    const NodeProg m_prog;
-    std::stringstream m_output;
-    size_t m_stack_size = 0;
-    std::vector<Var> m_vars{};
-    std::vector<size_t> m_scopes{};
-    int m_label_count = 0;
+    const IrProgram &m_program;
+    const LinearScan::Result m_allocation;
+    std::vector<uint8_t> m_has_label;
+    std::vector<Instr> m_code;
 };
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "registers.hpp"
+#include "utils/output_buffer.hpp"
+
+// The generator's output before it becomes text: a flat list of x86-64
+// instructions over a small set of opcodes and operand forms. Passes such as
+// the peephole optimizer work on this list; print_asm() turns it into NASM
+// source at the very end.
+
+enum class Opcode : uint8_t {
+    mov,
+    add,
+    sub,
+    imul,
+    mul,
+    div,
+    shl,
+    shr,
+    lea,
+    xor_,
+    test,
+    push,
+    pop,
+    jz,
+    jmp,
+    syscall,
+    label
+};
+
+inline constexpr std::string_view opcode_names[] = {
+        "mov", "add", "sub", "imul", "mul", "div", "shl", "shr", "lea", "xor", "test", "push", "pop", "jz", "jmp", "syscall", ""
+};
+
+// Register, immediate, a qword stack slot `[rsp + disp]` or, for lea only,
+// the address `[reg + index * scale]`. Registers are 64 bits wide unless
+// `dword` is set, which only the zero idiom uses.
+struct Operand {
+    enum class Kind : uint8_t {
+        none,
+        reg,
+        imm,
+        stack,
+        address
+    };
+
+    Kind kind = Kind::none;
+    Reg reg = Reg::rax;
+    Reg index = Reg::rax;
+    uint8_t scale = 1;
+    bool dword = false;
+    uint32_t disp = 0;
+    uint64_t imm = 0;
+
+    [[nodiscard]] inline bool is_reg(Reg other) const {
+        return kind == Kind::reg && reg == other;
+    }
+
+    inline bool operator==(const Operand &) const = default;
+};
+
+inline Operand reg_operand(Reg reg) {
+    return {.kind = Operand::Kind::reg, .reg = reg};
+}
+
+inline Operand imm_operand(uint64_t imm) {
+    return {.kind = Operand::Kind::imm, .imm = imm};
+}
+
+inline Operand stack_operand(uint32_t disp) {
+    return {.kind = Operand::Kind::stack, .disp = disp};
+}
+
+inline Operand address_operand(Reg base, Reg index, uint8_t scale) {
+    return {.kind = Operand::Kind::address, .reg = base, .index = index, .scale = scale};
+}
+
+// `label` is the label id of jz, jmp and label instructions.
+struct Instr {
+    Opcode op;
+    Operand dst{};
+    Operand src{};
+    uint32_t label = 0;
+};
+
+// `xor r32, r32`: the shortest way to clear a register.
+inline Instr zero(Reg reg) {
+    Operand operand = reg_operand(reg);
+    operand.dword = true;
+    return {.op = Opcode::xor_, .dst = operand, .src = operand};
+}
+
+inline std::string label_name(uint32_t label) {
+    return ".L" + std::to_string(label);
+}
+
+inline void print_label(OutputBuffer &out, uint32_t label) {
+    out.append(".L");
+    out.append_uint(label);
+}
+
+inline void print_operand(OutputBuffer &out, const Operand &operand) {
+    switch (operand.kind) {
+        case Operand::Kind::reg:
+            out.append(operand.dword ? reg_name32(operand.reg) : reg_name(operand.reg));
+            break;
+        case Operand::Kind::imm:
+            out.append_uint(operand.imm);
+            break;
+        case Operand::Kind::stack:
+            if (operand.disp == 0) {
+                out.append("QWORD [rsp]");
+            } else {
+                out.append("QWORD [rsp + ");
+                out.append_uint(operand.disp);
+                out.append(']');
+            }
+            break;
+        case Operand::Kind::address:
+            out.append('[');
+            out.append(reg_name(operand.reg));
+            out.append(" + ");
+            out.append(reg_name(operand.index));
+            out.append('*');
+            out.append_uint(operand.scale);
+            out.append(']');
+            break;
+        case Operand::Kind::none:
+            break;
+    }
+}
+
+// NASM source for a whole program starting at `_start`.
+inline void print_asm(OutputBuffer &out, std::span<const Instr> code) {
+    out.append("global _start\n_start:\n");
+    for (const Instr &instr: code) {
+        if (instr.op == Opcode::label) {
+            print_label(out, instr.label);
+            out.append(":\n");
+            continue;
+        }
+        out.append('\t');
+        out.append(opcode_names[static_cast<size_t>(instr.op)]);
+        if (instr.op == Opcode::jz || instr.op == Opcode::jmp) {
+            out.append(' ');
+            print_label(out, instr.label);
+        } else if (instr.dst.kind != Operand::Kind::none) {
+            out.append(' ');
+            print_operand(out, instr.dst);
+            if (instr.src.kind != Operand::Kind::none) {
+                out.append(", ");
+                print_operand(out, instr.src);
+            }
+        }
+        out.append('\n');
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using IdentId = uint32_t;
+
+// Maps identifier text to dense ids 0, 1, 2, ... in order of first
+// appearance, so per-identifier data can live in flat arrays indexed by id.
+// The interner stores views, not copies: the text has to outlive it (it
+// normally points into the source buffer).
+class Interner {
+public:
+    inline explicit Interner(size_t expected_names = 64) {
+        m_slots.resize(std::bit_ceil(std::max<size_t>(expected_names * 2, 16)));
+        m_names.reserve(expected_names);
+    }
+
+    inline IdentId intern(std::string_view name) {
+        const uint32_t hash = hash_of(name);
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot &slot = m_slots[i];
+            if (slot.id_plus_one == 0) {
+                const auto id = static_cast<IdentId>(m_names.size());
+                slot = {.id_plus_one = id + 1, .hash = hash};
+                m_names.push_back(name);
+                // Keep the load factor below one half.
+                if (m_names.size() * 2 > m_slots.size()) {
+                    grow();
+                }
+                return id;
+            }
+            if (slot.hash == hash && m_names[slot.id_plus_one - 1] == name) {
+                return slot.id_plus_one - 1;
+            }
+        }
+    }
+
+    [[nodiscard]] inline std::string_view name(IdentId id) const {
+        return m_names[id];
+    }
+
+    [[nodiscard]] inline size_t size() const {
+        return m_names.size();
+    }
+
+private:
+    struct Slot {
+        uint32_t id_plus_one = 0; // 0 marks an empty slot
+        uint32_t hash = 0;
+    };
+
+    // FNV-1a; identifiers are short, so this beats fancier hashes here.
+    static inline uint32_t hash_of(std::string_view name) {
+        uint32_t hash = 2166136261u;
+        for (const char c: name) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    inline void grow() {
+        std::vector<Slot> slots(m_slots.size() * 2);
+        const size_t mask = slots.size() - 1;
+        for (const Slot &slot: m_slots) {
+            if (slot.id_plus_one == 0) {
+                continue;
+            }
+            size_t i = slot.hash & mask;
+            while (slots[i].id_plus_one != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+        m_slots = std::move(slots);
+    }
+
+    std::vector<Slot> m_slots;
+    std::vector<std::string_view> m_names;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Mid-level IR between the AST and the x86-64 backend: a list of basic
+// blocks over virtual registers in SSA form. Every value is defined by
+// exactly one instruction and every block ends in a terminator.
+//
+// Blocks are stored in layout order, which is also the program's source
+// order, so all edges point forward. Block 0 is the entry.
+//
+// SSA needs phi nodes where different definitions of a variable meet. In
+// Cosmolingua a `let` binding is immutable and only visible inside its
+// scope, so at the join after an `if` every visible name still has the
+// definition it had before the branch and no phi is ever required.
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+
+enum class IrOp : uint8_t {
+    add,
+    sub,
+    mul,
+    div
+};
+
+inline constexpr std::string_view ir_op_names[] = {"add", "sub", "mul", "div"};
+
+// Instruction operand: a value or an immediate.
+struct IrArg {
+    bool is_imm = false;
+    uint64_t imm = 0;
+    ValueId value = 0;
+
+    static inline IrArg of(ValueId value) {
+        return {.value = value};
+    }
+
+    static inline IrArg constant(uint64_t imm) {
+        return {.is_imm = true, .imm = imm};
+    }
+};
+
+// `dst = op lhs, rhs`. Either operand may be an immediate; the backend
+// picks instructions that fit.
+struct IrInst {
+    IrOp op;
+    ValueId dst;
+    IrArg lhs;
+    IrArg rhs;
+};
+
+enum class TermKind : uint8_t {
+    jump,   // to `target`
+    branch, // to `target` if `arg` is non-zero, else to `other`
+    exit    // exit(`arg`)
+};
+
+struct Terminator {
+    TermKind kind = TermKind::exit;
+    IrArg arg{};
+    BlockId target = 0;
+    BlockId other = 0;
+};
+
+struct IrBlock {
+    std::vector<IrInst> insts;
+    Terminator term;
+    std::vector<BlockId> preds;
+};
+
+struct IrProgram {
+    std::vector<IrBlock> blocks;
+    uint32_t num_values = 0;
+
+    [[nodiscard]] inline size_t num_insts() const {
+        size_t count = 0;
+        for (const IrBlock &block: blocks) {
+            count += block.insts.size() + 1;
+        }
+        return count;
+    }
+};
+
+// Keeps the blocks listed in `order`, in that order, and drops the rest.
+// Terminators are renumbered and predecessor lists rebuilt. Blocks that are
+// kept must only branch to blocks that are kept.
+inline void reorder_blocks(IrProgram &program, const std::vector<BlockId> &order) {
+    std::vector<BlockId> new_id(program.blocks.size(), 0);
+    for (BlockId i = 0; i < order.size(); ++i) {
+        new_id[order[i]] = i;
+    }
+    std::vector<IrBlock> blocks;
+    blocks.reserve(order.size());
+    for (const BlockId id: order) {
+        IrBlock &block = blocks.emplace_back(std::move(program.blocks[id]));
+        block.term.target = new_id[block.term.target];
+        block.term.other = new_id[block.term.other];
+        block.preds.clear();
+    }
+    for (BlockId id = 0; id < blocks.size(); ++id) {
+        const Terminator &term = blocks[id].term;
+        if (term.kind == TermKind::jump || term.kind == TermKind::branch) {
+            blocks[term.target].preds.push_back(id);
+        }
+        if (term.kind == TermKind::branch && term.other != term.target) {
+            blocks[term.other].preds.push_back(id);
+        }
+    }
+    program.blocks = std::move(blocks);
+}
+
+inline std::string print_ir_arg(const IrArg &arg) {
+    return arg.is_imm ? std::to_string(arg.imm) : "v" + std::to_string(arg.value);
+}
+
+// Human-readable listing, one instruction per line.
+inline std::string print_ir(const IrProgram &program) {
+    std::string out;
+    for (BlockId id = 0; id < program.blocks.size(); ++id) {
+        const IrBlock &block = program.blocks[id];
+        out += "b" + std::to_string(id) + ":";
+        if (!block.preds.empty()) {
+            out += "  ; preds";
+            for (const BlockId pred: block.preds) {
+                out += " b" + std::to_string(pred);
+            }
+        }
+        out += '\n';
+        for (const IrInst &inst: block.insts) {
+            out += "\tv" + std::to_string(inst.dst) + " = " + std::string(ir_op_names[static_cast<size_t>(inst.op)]) +
+                   " " + print_ir_arg(inst.lhs) + ", " + print_ir_arg(inst.rhs) + "\n";
+        }
+        switch (block.term.kind) {
+            case TermKind::jump:
+                out += "\tjump b" + std::to_string(block.term.target) + "\n";
+                break;
+            case TermKind::branch:
+                out += "\tbranch " + print_ir_arg(block.term.arg) + ", b" + std::to_string(block.term.target) +
+                       ", b" + std::to_string(block.term.other) + "\n";
+                break;
+            case TermKind::exit:
+                out += "\texit " + print_ir_arg(block.term.arg) + "\n";
+                break;
+        }
+    }
+    return out;
+}
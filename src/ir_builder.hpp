@@ -0,0 +1,165 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "interner.hpp"
+#include "ir.hpp"
+#include "symbol_table.hpp"
+#include "utils/log.hpp"
+
+// Lowers the AST into SSA form. Names map to the IrArg holding their value,
+// so a variable reference costs no instruction and a `let` of a literal
+// stays an immediate. Statements after an `exit` land in a block without
+// predecessors; IrOptimizer removes such blocks.
+class IrBuilder {
+public:
+    // `names` is the interner the program was tokenized with.
+    inline explicit IrBuilder(const Ast &ast, const Interner &names)
+            : m_ast(ast), m_names(names), m_symbols(names.size()) {
+    }
+
+    [[nodiscard]] IrProgram build() {
+        start_block(new_block());
+        for (const NodeIndex stmt: m_ast.prog()) {
+            build_stmt(stmt);
+        }
+        terminate({.kind = TermKind::exit, .arg = IrArg::constant(0)});
+        return finish();
+    }
+
+    IrArg build_expr(NodeIndex expr) {
+        struct ExprVisitor {
+            IrBuilder *builder;
+
+            IrArg operator()(const NodeTermIntLit &term_int_lit) const {
+                return IrArg::constant(term_int_lit.value);
+            }
+
+            IrArg operator()(const NodeTermIdent &term_ident) const {
+                const IrArg *value = builder->m_symbols.lookup(term_ident.ident);
+                if (value == nullptr) {
+                    Log::error(4570, "Identifier: " + std::string(builder->m_names.name(term_ident.ident)));
+                }
+                return *value;
+            }
+
+            IrArg operator()(const NodeBinExprAdd &add) const {
+                return builder->build_bin_expr(IrOp::add, add.lhs, add.rhs);
+            }
+
+            IrArg operator()(const NodeBinExprSub &sub) const {
+                return builder->build_bin_expr(IrOp::sub, sub.lhs, sub.rhs);
+            }
+
+            IrArg operator()(const NodeBinExprMulti &multi) const {
+                return builder->build_bin_expr(IrOp::mul, multi.lhs, multi.rhs);
+            }
+
+            IrArg operator()(const NodeBinExprDiv &div) const {
+                return builder->build_bin_expr(IrOp::div, div.lhs, div.rhs);
+            }
+        };
+
+        return m_ast.visit_expr(expr, ExprVisitor{.builder = this});
+    }
+
+    void build_scope(const NodeScope &scope) {
+        m_symbols.begin_scope();
+        for (const NodeIndex stmt: scope.stmts) {
+            build_stmt(stmt);
+        }
+        m_symbols.end_scope();
+        Log::addProcess("Scope");
+    }
+
+    void build_stmt(NodeIndex stmt) {
+        struct StmtVisitor {
+            IrBuilder *builder;
+
+            void operator()(const NodeStmtExit &stmt_exit) const {
+                const IrArg value = builder->build_expr(stmt_exit.expr);
+                builder->terminate({.kind = TermKind::exit, .arg = value});
+                builder->start_block(builder->new_block());
+                Log::addProcess("Exit");
+            }
+
+            void operator()(const NodeStmtLet &stmt_let) const {
+                const std::string_view name = builder->m_names.name(stmt_let.ident);
+                // The value is computed before the name becomes visible, so
+                // `let x = x + 1;` in an inner scope reads the outer `x`.
+                const IrArg value = builder->build_expr(stmt_let.expr);
+                if (!builder->m_symbols.declare(stmt_let.ident, value)) {
+                    Log::error(4571, "Identifier: " + std::string(name));
+                }
+                Log::addProcess("Let Identifier: ", name);
+            }
+
+            void operator()(const NodeScope &scope) const {
+                builder->build_scope(scope);
+            }
+
+            void operator()(const NodeStmtIf &stmt_if) const {
+                const IrArg cond = builder->build_expr(stmt_if.expr);
+                const BlockId then_block = builder->new_block();
+                const BlockId join_block = builder->new_block();
+                builder->terminate({.kind = TermKind::branch, .arg = cond, .target = then_block,
+                                    .other = join_block});
+                builder->start_block(then_block);
+                builder->build_scope(builder->m_ast.scope(stmt_if.scope));
+                builder->terminate({.kind = TermKind::jump, .target = join_block});
+                // The scope's bindings are gone again, so every name has the
+                // value it had before the branch and the join needs no phi.
+                builder->start_block(join_block);
+                Log::addProcess("If Statement of ", stmt_if.expr);
+            }
+        };
+
+        m_ast.visit_stmt(stmt, StmtVisitor{.builder = this});
+    }
+
+private:
+    IrArg build_bin_expr(IrOp op, NodeIndex lhs_expr, NodeIndex rhs_expr) {
+        const IrArg lhs = build_expr(lhs_expr);
+        const IrArg rhs = build_expr(rhs_expr);
+        return emit(op, lhs, rhs);
+    }
+
+    IrArg emit(IrOp op, IrArg lhs, IrArg rhs) {
+        const ValueId dst = m_num_values++;
+        m_blocks[m_current].insts.push_back({.op = op, .dst = dst, .lhs = lhs, .rhs = rhs});
+        return IrArg::of(dst);
+    }
+
+    BlockId new_block() {
+        m_blocks.emplace_back();
+        return static_cast<BlockId>(m_blocks.size() - 1);
+    }
+
+    // Makes `block` the one instructions go to. Blocks are laid out in the
+    // order they are started in.
+    void start_block(BlockId block) {
+        m_current = block;
+        m_layout.push_back(block);
+    }
+
+    void terminate(const Terminator &term) {
+        m_blocks[m_current].term = term;
+    }
+
+    // Puts the blocks into layout order, the order they were started in.
+    IrProgram finish() {
+        IrProgram program{.blocks = std::move(m_blocks), .num_values = m_num_values};
+        reorder_blocks(program, m_layout);
+        return program;
+    }
+
+    const Ast &m_ast;
+    const Interner &m_names;
+    SymbolTable<IrArg> m_symbols;
+    std::vector<IrBlock> m_blocks;
+    std::vector<BlockId> m_layout;
+    BlockId m_current = 0;
+    uint32_t m_num_values = 0;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ir.hpp"
+
+// Control-flow and dead-code cleanup on the IR (-O1), in this order:
+//
+//   1. branches on a constant become jumps, so the `if` body that can never
+//      run loses its only predecessor;
+//   2. blocks unreachable from the entry are removed, i.e. dead `if` bodies
+//      and statements after `exit`;
+//   3. a block that is the only successor of its only predecessor is merged
+//      into it, which inlines always-taken `if` bodies and their joins;
+//   4. instructions whose value is never used are removed. That covers
+//      unused `let` bindings. A division is only removed when its divisor is
+//      a non-zero immediate, because dividing by zero traps.
+class IrOptimizer {
+public:
+    struct Stats {
+        size_t branches_folded = 0;
+        size_t blocks_removed = 0;
+        size_t blocks_merged = 0;
+        size_t insts_removed = 0;
+    };
+
+    // Rewrites `program` in place.
+    inline Stats run(IrProgram &program) {
+        m_stats = {};
+        fold_branches(program);
+        remove_unreachable(program);
+        merge_blocks(program);
+        remove_dead_insts(program);
+        return m_stats;
+    }
+
+private:
+    void fold_branches(IrProgram &program) {
+        for (IrBlock &block: program.blocks) {
+            Terminator &term = block.term;
+            if (term.kind == TermKind::branch && term.arg.is_imm) {
+                term = {.kind = TermKind::jump, .target = term.arg.imm != 0 ? term.target : term.other};
+                m_stats.branches_folded++;
+            }
+        }
+    }
+
+    void remove_unreachable(IrProgram &program) {
+        // Edges point forward in layout order, so one pass finds every
+        // reachable block.
+        std::vector<uint8_t> reachable(program.blocks.size(), 0);
+        std::vector<BlockId> order;
+        order.reserve(program.blocks.size());
+        reachable[0] = 1;
+        for (BlockId id = 0; id < program.blocks.size(); ++id) {
+            if (!reachable[id]) {
+                continue;
+            }
+            order.push_back(id);
+            const Terminator &term = program.blocks[id].term;
+            if (term.kind == TermKind::jump || term.kind == TermKind::branch) {
+                reachable[term.target] = 1;
+            }
+            if (term.kind == TermKind::branch) {
+                reachable[term.other] = 1;
+            }
+        }
+        m_stats.blocks_removed += program.blocks.size() - order.size();
+        if (order.size() != program.blocks.size()) {
+            reorder_blocks(program, order);
+        }
+    }
+
+    void merge_blocks(IrProgram &program) {
+        std::vector<uint8_t> merged(program.blocks.size(), 0);
+        std::vector<BlockId> order;
+        order.reserve(program.blocks.size());
+        for (BlockId id = 0; id < program.blocks.size(); ++id) {
+            if (merged[id]) {
+                continue;
+            }
+            order.push_back(id);
+            IrBlock &block = program.blocks[id];
+            while (block.term.kind == TermKind::jump) {
+                const BlockId next_id = block.term.target;
+                IrBlock &next = program.blocks[next_id];
+                if (next.preds.size() != 1) {
+                    break;
+                }
+                block.insts.insert(block.insts.end(), next.insts.begin(), next.insts.end());
+                block.term = next.term;
+                merged[next_id] = 1;
+                m_stats.blocks_merged++;
+            }
+        }
+        if (order.size() != program.blocks.size()) {
+            reorder_blocks(program, order);
+        }
+    }
+
+    void remove_dead_insts(IrProgram &program) {
+        // Values are used after they are defined in layout order, so one
+        // backward pass sees every use before the definition.
+        std::vector<uint8_t> used(program.num_values, 0);
+        const auto use = [&](const IrArg &arg) {
+            if (!arg.is_imm) {
+                used[arg.value] = 1;
+            }
+        };
+        for (size_t b = program.blocks.size(); b-- > 0;) {
+            IrBlock &block = program.blocks[b];
+            if (block.term.kind != TermKind::jump) {
+                use(block.term.arg);
+            }
+            std::vector<IrInst> &insts = block.insts;
+            size_t kept = insts.size();
+            for (size_t i = insts.size(); i-- > 0;) {
+                const IrInst &inst = insts[i];
+                const bool may_trap = inst.op == IrOp::div && !(inst.rhs.is_imm && inst.rhs.imm != 0);
+                if (!used[inst.dst] && !may_trap) {
+                    m_stats.insts_removed++;
+                    continue;
+                }
+                use(inst.lhs);
+                use(inst.rhs);
+                insts[--kept] = inst;
+            }
+            insts.erase(insts.begin(), insts.begin() + static_cast<std::ptrdiff_t>(kept));
+        }
+    }
+
+    Stats m_stats;
+};
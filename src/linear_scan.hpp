@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "ir.hpp"
+#include "registers.hpp"
+
+// Where a value lives for its whole lifetime: a register or a stack slot of
+// the frame (`[rsp + slot * 8]`).
+struct Location {
+    bool in_register = false;
+    Reg reg = Reg::rax;
+    uint32_t slot = 0;
+};
+
+// Linear-scan register allocation (Poletto & Sarkar) over the IR. All edges
+// of an IrProgram point forward in layout order, so the interval from a
+// value's definition to its last use in that order covers every path on
+// which it is live. When no register is free, whichever of the new and the
+// active intervals ends last goes to a stack slot.
+class LinearScan {
+public:
+    struct Result {
+        std::vector<Location> locations; // indexed by ValueId
+        uint32_t num_slots = 0;
+        size_t num_spilled = 0;
+    };
+
+    inline explicit LinearScan(size_t num_regs = allocatable_regs.size())
+            : m_regs(num_regs) {
+    }
+
+    Result run(const IrProgram &program) {
+        compute_intervals(program);
+        m_result = {};
+        m_result.locations.resize(program.num_values);
+        m_active.clear();
+        m_slot_end.clear();
+        uint32_t pos = 0;
+        for (const IrBlock &block: program.blocks) {
+            for (const IrInst &inst: block.insts) {
+                expire(pos);
+                allocate(inst.dst, inst.lhs);
+                pos++;
+            }
+            pos++;
+        }
+        return std::move(m_result);
+    }
+
+private:
+    void compute_intervals(const IrProgram &program) {
+        m_start.assign(program.num_values, 0);
+        m_end.assign(program.num_values, 0);
+        uint32_t pos = 0;
+        const auto use = [&](const IrArg &arg) {
+            if (!arg.is_imm) {
+                m_end[arg.value] = std::max(m_end[arg.value], pos);
+            }
+        };
+        for (const IrBlock &block: program.blocks) {
+            for (const IrInst &inst: block.insts) {
+                use(inst.lhs);
+                use(inst.rhs);
+                m_start[inst.dst] = pos;
+                m_end[inst.dst] = pos;
+                pos++;
+            }
+            if (block.term.kind != TermKind::jump) {
+                use(block.term.arg);
+            }
+            pos++;
+        }
+    }
+
+    // Frees the registers of intervals that end at or before `pos`. A value
+    // last used by the instruction at `pos` gives up its register to that
+    // instruction's result.
+    void expire(uint32_t pos) {
+        std::erase_if(m_active, [&](ValueId value) {
+            if (m_end[value] > pos) {
+                return false;
+            }
+            m_regs.release(m_result.locations[value].reg);
+            return true;
+        });
+    }
+
+    void allocate(ValueId value, const IrArg &lhs) {
+        // Reusing the lhs register turns the two-address `mov dst, lhs` into
+        // a no-op.
+        if (!lhs.is_imm && m_result.locations[lhs.value].in_register
+            && m_regs.take(m_result.locations[lhs.value].reg)) {
+            assign_register(value, m_result.locations[lhs.value].reg);
+            return;
+        }
+        if (const std::optional<Reg> reg = m_regs.alloc()) {
+            assign_register(value, *reg);
+            return;
+        }
+        const auto furthest = std::max_element(m_active.begin(), m_active.end(), [&](ValueId a, ValueId b) {
+            return m_end[a] < m_end[b];
+        });
+        if (furthest != m_active.end() && m_end[*furthest] > m_end[value]) {
+            const ValueId spilled = *furthest;
+            m_active.erase(furthest);
+            assign_register(value, m_result.locations[spilled].reg);
+            assign_slot(spilled);
+        } else {
+            assign_slot(value);
+        }
+    }
+
+    void assign_register(ValueId value, Reg reg) {
+        m_result.locations[value] = {.in_register = true, .reg = reg};
+        m_active.push_back(value);
+    }
+
+    void assign_slot(ValueId value) {
+        // A slot can be shared by intervals that do not overlap.
+        uint32_t slot = 0;
+        while (slot < m_slot_end.size() && m_slot_end[slot] >= m_start[value]) {
+            slot++;
+        }
+        if (slot == m_slot_end.size()) {
+            m_slot_end.push_back(0);
+        }
+        m_slot_end[slot] = m_end[value];
+        m_result.locations[value] = {.in_register = false, .slot = slot};
+        m_result.num_slots = std::max(m_result.num_slots, slot + 1);
+        m_result.num_spilled++;
+    }
+
+    RegisterPool m_regs;
+    Result m_result;
+    std::vector<uint32_t> m_start;
+    std::vector<uint32_t> m_end;
+    std::vector<ValueId> m_active;
+    std::vector<uint32_t> m_slot_end;
+};
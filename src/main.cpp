@@ -1,79 +1,394 @@
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <numeric>
 #include <optional>
 #include <sstream>
+#include <unordered_set>
 #include <vector>
 #include <chrono>
 
 #include "./tokenization.hpp"
 #include "./parser.hpp"
+#include "./encoder.hpp"
 #include "./generation.hpp"
+#include "./ir_builder.hpp"
+#include "./ir_optimizer.hpp"
+#include "./optimizer.hpp"
+#include "./peephole.hpp"
+#include "./options.hpp"
+#include "./utils/compile_cache.hpp"
+#include "./utils/compile_stats.hpp"
+#include "./utils/elf_writer.hpp"
 #include "./utils/log.hpp"
+#include "./utils/source_file.hpp"
+#include "./utils/work_stealing_pool.hpp"
 
-int main(int argc, char *argv[]) {
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-
-    // Add ipl
-
-    if (argc != 2) {
-        std::cerr << "Incorrect usage. Correct usage is..." << std::endl;
-        std::cerr << "cosmolingua <input.cl>" << std::endl;
-        Log::error(1948);
-        return EXIT_FAILURE;
+namespace {
+    // The files a build with `options` writes, as suffixes of the output
+    // path.
+    std::vector<std::string_view> output_suffixes(const Options &options) {
+        std::vector<std::string_view> suffixes = {""};
+        if (options.backend == Backend::nasm) {
+            suffixes.emplace_back(".o");
+        }
+        if (options.backend == Backend::nasm || options.emit_asm) {
+            suffixes.emplace_back(".asm");
+        }
+        if (options.emit_ir) {
+            suffixes.emplace_back(".ir");
+        }
+        return suffixes;
     }
 
-    Log::add("Starting Cosmolang Architecture Compiler");
+    std::string shell_quote(const std::string &text) {
+        std::string quoted = "'";
+        for (const char c: text) {
+            quoted += c == '\'' ? "'\\''" : std::string(1, c);
+        }
+        return quoted + "'";
+    }
 
-    std::string contents;
-    {
-        std::stringstream contents_stream;
-        std::fstream input(argv[1], std::ios::in);
-        contents_stream << input.rdbuf();
-        contents = contents_stream.str();
+    // Compiles `input` to the executable `output`, with the other output
+    // files named `output` plus a suffix. Every stage of the pipeline lives
+    // in this call, so compilations on different threads share nothing but
+    // the log. `verbose` prints the progress lines of single-file mode.
+    // Errors go through Log::error(). Returns whether the build was restored
+    // from the cache.
+    bool compile_file(const Options &options, const std::string &input, const std::string &output,
+                      CompileStats &stats, bool verbose) {
+        // `source` owns the (usually memory-mapped) program text. Tokens only
+        // refer to it by offset, so it has to stay alive until generation is done.
+        stats.begin_phase("read");
+        SourceFile source(input);
+        const std::string_view contents = source.view();
         if (contents.empty()) {
             Log::error(2054);
-            return EXIT_FAILURE;
         }
-    }
-    std::cout << "Reading successfully." << std::endl;
-    Log::add("Reading successfully.");
-
-    Tokenizer tokenizer(std::move(contents));
-    std::vector<Token> tokens = tokenizer.tokenize();
-    std::cout << "AST and Tokenization successfully." << std::endl;
-    Log::add("AST and Tokenization successfully.");
-
-    // Integrate Cosmolang Linker and Cosmolang Assembler ICL and ICA
-    Parser parser(std::move(tokens));
-    std::optional<NodeProg> prog = parser.parse_prog();
-    std::cout << "Parsing successfully." << std::endl;
-    Log::add("Parsing successfully.");
-
-    if (!prog.has_value()) {
-        Log::error(2301);
+        stats.end_phase();
+        stats.set_count("source_bytes", contents.size());
+        if (verbose) {
+            std::cout << "Reading successfully." << std::endl;
+        }
+        Log::add("Reading successfully.");
+
+        // An identical earlier build is restored and nothing else runs.
+        std::optional<CompileCache> cache;
+        std::string cache_key;
+        if (options.cache_dir.has_value()) {
+            stats.begin_phase("cache_lookup");
+            cache.emplace(*options.cache_dir, options.cache_megabytes * 1024 * 1024);
+            cache_key = CompileCache::key(contents, cache_configuration(options, CompileCache::compiler_identity()));
+            const bool hit = cache->restore(cache_key, output);
+            stats.end_phase();
+            stats.set_count("cache_hits", cache->counters().hits);
+            stats.set_count("cache_misses", cache->counters().misses);
+            if (hit) {
+                if (verbose) {
+                    std::cout << "Restored from cache. (Build)" << std::endl;
+                }
+                Log::addInfo("Cache: hit ", cache_key);
+                Log::add("Build successfully.");
+                return true;
+            }
+            Log::addInfo("Cache: miss ", cache_key);
+        }
+
+        // Identifier ids shared by the tokenizer, the parser and the generator.
+        Interner names(contents.size() / 256);
+        Tokenizer tokenizer(contents, names);
+        std::optional<Parser> parser;
+        if (options.stream) {
+            parser.emplace(tokenizer);
+        } else {
+            stats.begin_phase("tokenize");
+            std::vector<Token> tokens = tokenizer.tokenize();
+            stats.end_phase();
+            if (verbose) {
+                std::cout << "AST and Tokenization successfully." << std::endl;
+            }
+            Log::add("AST and Tokenization successfully.");
+            parser.emplace(std::move(tokens), contents);
+        }
+
+        // Integrate Cosmolang Linker and Cosmolang Assembler ICL and ICA
+        // In --stream mode this includes tokenization.
+        stats.begin_phase("parse");
+        std::optional<Ast> prog = parser->parse_prog();
+        stats.end_phase(parser->arena_stats().high_water_mark);
+        stats.set_count("tokens", parser->tokens_read());
+        if (verbose) {
+            std::cout << "Parsing successfully." << std::endl;
+        }
+        Log::add("Parsing successfully.");
+        const ArenaAllocator::Stats arena_stats = parser->arena_stats();
+        Log::addInfo("AST arena: ", arena_stats.bytes_used, " bytes used, ", arena_stats.bytes_reserved,
+                     " bytes reserved in ", arena_stats.chunk_count, " chunk(s), high-water mark ",
+                     arena_stats.high_water_mark, " bytes");
+
+        if (!prog.has_value()) {
+            Log::error(2301);
+        }
+        stats.set_count("ast_nodes", prog->size());
+
+        if (options.opt_level >= 1) {
+            stats.begin_phase("ast_optimize");
+            Optimizer optimizer(prog.value(), names);
+            const Optimizer::Stats optimizer_stats = optimizer.run();
+            stats.end_phase(parser->arena_stats().high_water_mark);
+            Log::addInfo("Optimizer: ", optimizer_stats.folded, " expression(s) folded, ",
+                         optimizer_stats.propagated, " constant(s) propagated, ", optimizer_stats.simplified,
+                         " identit(ies) simplified");
+        }
+
+        stats.begin_phase("ir_build");
+        IrProgram ir = IrBuilder(prog.value(), names).build();
+        stats.end_phase();
+        if (options.opt_level >= 1) {
+            stats.begin_phase("ir_optimize");
+            const IrOptimizer::Stats ir_stats = IrOptimizer().run(ir);
+            stats.end_phase();
+            Log::addInfo("IR optimizer: ", ir_stats.branches_folded, " branch(es) folded, ",
+                         ir_stats.blocks_removed, " unreachable block(s) removed, ", ir_stats.blocks_merged,
+                         " block(s) merged, ", ir_stats.insts_removed, " unused instruction(s) removed");
+        }
+        stats.set_count("ir_instructions", ir.num_insts());
+        Log::addInfo("IR: ", ir.blocks.size(), " block(s), ", ir.num_values, " value(s), ", ir.num_insts(),
+                     " instruction(s)");
+        if (options.emit_ir) {
+            std::fstream file(output + ".ir", std::ios::out);
+            file << print_ir(ir);
+        }
+
+        stats.begin_phase("codegen");
+        Generator generator(ir, options.num_regs);
+        std::vector<Instr> code = generator.gen_prog();
+        stats.end_phase();
+        if (options.opt_level >= 2) {
+            stats.begin_phase("peephole");
+            Peephole peephole;
+            const Peephole::Stats peephole_stats = peephole.run(code);
+            stats.end_phase();
+            Log::addInfo("Peephole: ", peephole_stats.instrs_before, " -> ", peephole_stats.instrs_after,
+                         " instructions");
+            for (size_t rule = 0; rule < Peephole::rule_count; ++rule) {
+                if (peephole_stats.hits[rule] != 0) {
+                    Log::addInfo("Peephole rule ", Peephole::rule_names[rule], ": ", peephole_stats.hits[rule],
+                                 " hit(s)");
+                }
+            }
+        }
+        stats.set_count("instructions", code.size());
+        if (options.backend == Backend::nasm || options.emit_asm) {
+            stats.begin_phase("emit_asm");
+            OutputBuffer file(output + ".asm");
+            print_asm(file, code);
+            stats.set_count("asm_bytes", file.size());
+            file.close();
+            stats.end_phase();
+        }
+        if (verbose) {
+            std::cout << "Generation successfully." << std::endl;
+        }
+        Log::add("Generation successfully.");
+        Log::addSuccess("Generation of Program successfully.");
+
+        if (options.backend == Backend::builtin) {
+            stats.begin_phase("assemble");
+            const std::vector<uint8_t> bytes = X86Encoder().encode(code);
+            stats.end_phase();
+            stats.set_count("code_bytes", bytes.size());
+            Log::addInfo("Encoder: ", code.size(), " instruction(s), ", bytes.size(), " byte(s) of code");
+            stats.begin_phase("link");
+            write_elf_executable(output, bytes);
+            stats.end_phase();
+            if (verbose) {
+                std::cout << "Encoding and writing successfully. (Build)" << std::endl;
+            }
+            Log::add("Build successfully.");
+        } else {
+            stats.begin_phase("assemble");
+            // Batch mode checks for nasm once, before it starts.
+            if (verbose) {
+                // Check if nasm is installed
+                if (system("nasm -v") != 0) {
+                    Log::error(7768, "nasm is not installed. Please install nasm.");
+                }
+                Log::addInfo("Nasm is installed");
+
+                Log::addWarning("NASM's program only works on Linux. Please use WSL or Linux to run the program.");
+            }
+
+            // Later add Integrate Cosmolang Linker and Cosmolang Assembler ICL and ICA And ICO (Integrate Cosmolang Object)
+            // The child processes' CPU time and memory are not included.
+            const std::string object = shell_quote(output + ".o");
+            if (system(("nasm -f elf64 " + shell_quote(output + ".asm") + " -o " + object).c_str()) != 0) {
+                Log::error(2057, "File: " + output + ".o");
+            }
+            stats.end_phase();
+            stats.begin_phase("link");
+            if (system(("ld " + object + " -o " + shell_quote(output)).c_str()) != 0) {
+                Log::error(2057, "File: " + output);
+            }
+            stats.end_phase();
+            if (verbose) {
+                std::cout << "Linking and Assembling successfully. (Build)" << std::endl;
+            }
+            Log::add("Build successfully.");
+        }
+
+        // Only a complete build gets here to be reused.
+        if (cache.has_value()) {
+            stats.begin_phase("cache_store");
+            cache->store(cache_key, output, output_suffixes(options));
+            stats.end_phase();
+        }
+        return false;
     }
 
-    Generator generator(prog.value());
-    {
-        std::fstream file("output.asm", std::ios::out);
-        file << generator.gen_prog();
+    struct BatchJob {
+        std::string input;
+        std::string output;
+    };
+
+    // The inputs on the command line, then those of the manifest.
+    std::vector<BatchJob> batch_jobs(const Options &options) {
+        std::vector<BatchJob> jobs;
+        for (const std::string &input: options.inputs) {
+            jobs.push_back({.input = input, .output = std::filesystem::path(input).replace_extension().string()});
+        }
+        if (!options.manifest.empty()) {
+            std::ifstream manifest(options.manifest);
+            if (!manifest) {
+                Log::error(2058, "File: " + options.manifest);
+            }
+            for (std::string line; std::getline(manifest, line);) {
+                std::istringstream fields(line);
+                BatchJob job;
+                if (!(fields >> job.input) || job.input.starts_with('#')) {
+                    continue;
+                }
+                if (!(fields >> job.output)) {
+                    job.output = std::filesystem::path(job.input).replace_extension().string();
+                }
+                jobs.push_back(std::move(job));
+            }
+        }
+        std::unordered_set<std::string> outputs;
+        for (const BatchJob &job: jobs) {
+            if (job.output == job.input || !outputs.insert(job.output).second) {
+                Log::error(2059, "Output: " + job.output);
+            }
+        }
+        return jobs;
     }
-    std::cout << "Generation successfully." << std::endl;
-    Log::add("Generation successfully.");
-    Log::addSuccess("Generation of Program successfully.");
 
-    // Check if nasm is installed
-    if (system("nasm -v") != 0) {
-        Log::error(7768, "nasm is not installed. Please install nasm.");
+    // Compiles every job on a work-stealing pool, each with its own
+    // pipeline state; errors end only the compilation they occur in.
+    // Returns the exit code of the batch.
+    int run_batch(const Options &options, CompileStats &stats) {
+        const std::vector<BatchJob> jobs = batch_jobs(options);
+        if (options.backend == Backend::nasm && system("nasm -v") != 0) {
+            Log::error(7768, "nasm is not installed. Please install nasm.");
+        }
+
+        // Largest first, so no big file starts last and holds up the end.
+        std::vector<uintmax_t> sizes(jobs.size());
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            std::error_code ec;
+            sizes[i] = std::filesystem::file_size(jobs[i].input, ec);
+            sizes[i] = ec ? 0 : sizes[i];
+        }
+        std::vector<size_t> order(jobs.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+        struct Result {
+            int code = 0;
+            bool cached = false;
+            double ms = 0;
+        };
+        std::vector<Result> results(jobs.size());
+
+        WorkStealingPool pool(options.jobs);
+        stats.begin_phase("batch");
+        Log::setThreadSafe(true);
+        pool.run(jobs.size(), [&](size_t index) {
+            const BatchJob &job = jobs[order[index]];
+            Result &result = results[order[index]];
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            const Log::ErrorScope scope(job.input);
+            Log::addInfo("Batch: compiling ", job.input, " to ", job.output);
+            // The batch report only has the batch as a whole; each job gets
+            // its own, measured on the thread that compiles it.
+            CompileStats job_stats(CompileStats::Scope::thread);
+            job_stats.enable(options.time_report, options.stats_json, job.output + ".stats.json", job.input);
+            try {
+                result.cached = compile_file(options, job.input, job.output, job_stats, false);
+            } catch (const CompileError &error) {
+                result.code = error.code();
+            } catch (const std::exception &error) {
+                std::cerr << job.input + ": " + error.what() + "\n" << std::flush;
+                Log::addFatal("Batch: ", job.input, ": ", error.what());
+                result.code = EXIT_FAILURE;
+            }
+            job_stats.finish(result.code);
+            result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        });
+        Log::setThreadSafe(false);
+        stats.end_phase();
+
+        size_t failed = 0;
+        size_t cached = 0;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            const Result &result = results[i];
+            std::cout << jobs[i].input << " -> ";
+            if (result.code != 0) {
+                std::cout << "failed (error code " << result.code << ")" << std::endl;
+                ++failed;
+                continue;
+            }
+            std::cout << jobs[i].output << (result.cached ? " (cached)" : "") << " in "
+                      << static_cast<int64_t>(result.ms) << "ms" << std::endl;
+            cached += result.cached ? 1 : 0;
+        }
+        std::cout << "Batch: " << jobs.size() - failed << " of " << jobs.size() << " file(s) built on "
+                  << std::min(pool.size(), jobs.size()) << " thread(s)" << std::endl;
+        Log::addInfo("Batch: ", jobs.size(), " file(s), ", failed, " failed, ", cached, " from the cache");
+        stats.set_count("files", jobs.size());
+        stats.set_count("failed", failed);
+        stats.set_count("cache_hits", cached);
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-    Log::addInfo("Nasm is installed");
+}
+
+int main(int argc, char *argv[]) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    CompileStats stats;
+
+    // Add ipl
+
+    const Options options = parse_options(argc, argv);
+    Log::setLevel(options.log_level);
+    stats.enable(options.time_report, options.stats_json);
+    // Every way out, errors included, goes through Log::createFile().
+    Log::setExitHook([&stats](int code) { stats.finish(code); });
+
+    Log::add("Starting Cosmolang Architecture Compiler");
 
-    Log::addWarning("NASM's program only works on Linux. Please use WSL or Linux to run the program.");
+    if (options.batch) {
+        const int code = run_batch(options, stats);
+
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::cout << "Compilation Time: "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms" << std::endl;
+
+        Log::createFile(code);
+        return code;
+    }
 
-    // Later add Integrate Cosmolang Linker and Cosmolang Assembler ICL and ICA And ICO (Integrate Cosmolang Object)
-    system("nasm -f elf64 output.asm -o output.o && ld output.o -o output");
-    std::cout << "Linking and Assembling successfully. (Build)" << std::endl;
-    Log::add("Build successfully.");
+    compile_file(options, options.inputs.front(), "output", stats, true);
 
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     std::cout << "Compilation Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()
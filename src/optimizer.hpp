@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "ast.hpp"
+#include "symbol_table.hpp"
+
+// AST simplification run between parsing and generation (-O1). It walks the
+// statements in program order and rewrites expression nodes in place:
+//
+//   - binary expressions with constant operands become integer literals
+//     (with the generator's wrap-around 64-bit unsigned semantics),
+//   - references to `let` variables bound to a constant become literals,
+//   - x + 0, 0 + x, x - 0, x * 1, 1 * x and x / 1 become x, and
+//     x * 0 and 0 * x become 0 unless x may divide by zero.
+//
+// Division by zero, or by a divisor that is not a known constant, is left
+// for the program to trap on at run time, as IrOptimizer does.
+// Unknown or redeclared names are ignored here; the generator reports them.
+class Optimizer {
+public:
+    struct Stats {
+        size_t folded = 0;      // binary expressions replaced by their value
+        size_t propagated = 0;  // variable references replaced by a constant
+        size_t simplified = 0;  // identities applied
+    };
+
+    inline explicit Optimizer(Ast &ast, const Interner &names)
+            : m_ast(ast), m_constants(names.size()) {
+    }
+
+    inline Stats run() {
+        for (const NodeIndex stmt: m_ast.prog()) {
+            optimize_stmt(stmt);
+        }
+        return m_stats;
+    }
+
+    // Folds the expression at `expr` and returns its value if it is constant.
+    std::optional<uint64_t> fold_expr(NodeIndex expr) {
+        const AstNode node = m_ast.node(expr);
+        switch (node.tag) {
+            case NodeTag::term_int_lit:
+                return Ast::int_lit_value(node);
+            case NodeTag::term_ident: {
+                const std::optional<uint64_t> *constant = m_constants.lookup(node.a);
+                if (constant == nullptr || !constant->has_value()) {
+                    return {};
+                }
+                m_ast.replace(expr, Ast::int_lit_node(**constant));
+                m_stats.propagated++;
+                return *constant;
+            }
+            case NodeTag::bin_expr_add:
+            case NodeTag::bin_expr_sub:
+            case NodeTag::bin_expr_multi:
+            case NodeTag::bin_expr_div:
+                return fold_bin_expr(expr, node);
+            default:
+                std::unreachable();
+        }
+    }
+
+    void optimize_stmt(NodeIndex stmt) {
+        const AstNode &node = m_ast.node(stmt);
+        switch (node.tag) {
+            case NodeTag::stmt_exit:
+                fold_expr(node.a);
+                break;
+            case NodeTag::stmt_let: {
+                // Folded before the name is declared, like the generator
+                // evaluates it, so an inner `let x = x + 1;` reads the outer x.
+                const IdentId ident = node.b;
+                const std::optional<uint64_t> value = fold_expr(node.a);
+                m_constants.declare(ident, value);
+                break;
+            }
+            case NodeTag::stmt_scope:
+                optimize_scope(stmt);
+                break;
+            case NodeTag::stmt_if: {
+                const NodeIndex scope = node.b;
+                fold_expr(node.a);
+                optimize_scope(scope);
+                break;
+            }
+            default:
+                std::unreachable();
+        }
+    }
+
+private:
+    void optimize_scope(NodeIndex scope) {
+        m_constants.begin_scope();
+        for (const NodeIndex stmt: m_ast.scope(scope).stmts) {
+            optimize_stmt(stmt);
+        }
+        m_constants.end_scope();
+    }
+
+    std::optional<uint64_t> fold_bin_expr(NodeIndex expr, const AstNode &node) {
+        const std::optional<uint64_t> lhs = fold_expr(node.a);
+        const std::optional<uint64_t> rhs = fold_expr(node.b);
+        if (lhs.has_value() && rhs.has_value()) {
+            uint64_t value;
+            switch (node.tag) {
+                case NodeTag::bin_expr_add:
+                    value = *lhs + *rhs;
+                    break;
+                case NodeTag::bin_expr_sub:
+                    value = *lhs - *rhs;
+                    break;
+                case NodeTag::bin_expr_multi:
+                    value = *lhs * *rhs;
+                    break;
+                default:
+                    if (*rhs == 0) {
+                        return {};
+                    }
+                    value = *lhs / *rhs;
+                    break;
+            }
+            m_ast.replace(expr, Ast::int_lit_node(value));
+            m_stats.folded++;
+            return value;
+        }
+
+        // At most one side is constant from here on.
+        const bool commutative = node.tag == NodeTag::bin_expr_add || node.tag == NodeTag::bin_expr_multi;
+        const uint64_t identity = node.tag == NodeTag::bin_expr_add || node.tag == NodeTag::bin_expr_sub ? 0 : 1;
+        if (rhs == identity) {
+            m_ast.replace(expr, m_ast.node(node.a));
+        } else if (commutative && lhs == identity) {
+            m_ast.replace(expr, m_ast.node(node.b));
+        } else if (node.tag == NodeTag::bin_expr_multi && (lhs == 0u || rhs == 0u) &&
+                   !may_trap(lhs == 0u ? node.b : node.a)) {
+            m_ast.replace(expr, Ast::int_lit_node(0));
+            m_stats.simplified++;
+            return 0;
+        } else {
+            return {};
+        }
+        m_stats.simplified++;
+        return {};
+    }
+
+    // Whether evaluating the (already folded) expression may divide by zero:
+    // it contains a division whose divisor is not a non-zero literal.
+    [[nodiscard]] bool may_trap(NodeIndex expr) const {
+        const AstNode &node = m_ast.node(expr);
+        switch (node.tag) {
+            case NodeTag::bin_expr_div: {
+                const AstNode &divisor = m_ast.node(node.b);
+                if (divisor.tag != NodeTag::term_int_lit || Ast::int_lit_value(divisor) == 0) {
+                    return true;
+                }
+                return may_trap(node.a);
+            }
+            case NodeTag::bin_expr_add:
+            case NodeTag::bin_expr_sub:
+            case NodeTag::bin_expr_multi:
+                return may_trap(node.a) || may_trap(node.b);
+            default:
+                return false;
+        }
+    }
+
+    Ast &m_ast;
+    SymbolTable<std::optional<uint64_t>> m_constants;
+    Stats m_stats;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <charconv>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "registers.hpp"
+#include "utils/compile_cache.hpp"
+#include "utils/log.hpp"
+
+// Command line of the compiler driver:
+//
+//   cosmolingua [options] <input.cl | ->
+//   cosmolingua [options] --batch <input.cl>... [--manifest=FILE]
+//
+//   --stream   tokenize on demand while parsing instead of lexing the whole
+//              file up front; token memory stays constant for any input size
+//   -O0..-O2   optimisation level: -O0 only replaces multiplication and
+//              division by constants with cheaper instructions; -O1 also
+//              folds constants and simplifies the AST, then folds constant
+//              branches and removes unreachable and unused code in the IR,
+//              which leaves no such arithmetic; -O2 (the default) also runs
+//              the peephole optimizer over the generated instructions
+//   --emit-ir  also write the intermediate representation to output.ir
+//   --regs=N   let the generator use at most N registers (1 to 13) for
+//              temporaries and variables; more are spilled to the stack
+//   --backend=builtin|nasm
+//              builtin (the default) encodes the instructions and writes the
+//              executable itself; nasm writes output.asm and runs nasm and ld,
+//              which is kept as a reference for differential testing
+//   --emit-asm also write output.asm with the builtin backend
+//   --time-report
+//              print wall and CPU time, peak RSS, heap allocations and arena
+//              use per compiler phase to stderr, also when compilation fails
+//   --stats=json
+//              write the same numbers and the token, AST node and
+//              instruction counts to output.stats.json
+//              In batch mode both also cover each input on its own, measured
+//              on the thread that compiles it (without peak RSS): one more
+//              table per input, and `<output>.stats.json` next to its output.
+//   --log-level=LEVEL
+//              lowest level recorded in the log file: process (traces every
+//              compiler step), info (the default), log, success, warning,
+//              fatal or error
+//   --cache[=DIR]
+//              restore the output files from an on-disk cache when the same
+//              source was built before with this compiler and these options,
+//              and save them there otherwise; DIR defaults to
+//              $COSARCH_CACHE_DIR, then ~/.cache/cosarch
+//   --cache-size=MB
+//              evict the least recently used cache entries beyond this size
+//              (default 256)
+//   --batch    compile every input to its own executable, named like the
+//              input without its extension (`src/a.cl` -> `src/a`), with
+//              the other output files next to it (`src/a.asm`, ...);
+//              compilations run in parallel and one failing does not stop
+//              the others
+//   --manifest=FILE
+//              batch mode with the inputs listed in FILE, one per line as
+//              `input [output]`; blank lines and lines starting with # are
+//              skipped
+//   --jobs=N   threads for batch mode (default: one per hardware thread)
+inline constexpr int max_opt_level = 2;
+
+enum class Backend {
+    builtin,
+    nasm,
+};
+
+struct Options {
+    // Exactly one unless in batch mode.
+    std::vector<std::string> inputs;
+    bool stream = false;
+    bool emit_ir = false;
+    int opt_level = max_opt_level;
+    size_t num_regs = allocatable_regs.size();
+    Backend backend = Backend::builtin;
+    bool emit_asm = false;
+    LogLevel log_level = LogLevel::info;
+    bool time_report = false;
+    bool stats_json = false;
+    std::optional<std::filesystem::path> cache_dir;
+    uint64_t cache_megabytes = 256;
+    bool batch = false;
+    std::string manifest;
+    size_t jobs = 0;
+};
+
+// Everything besides the source that decides the files a build writes; part
+// of the compile cache key. Options that only affect how the compiler gets
+// there (--stream, reporting, logging) are left out, so they share entries.
+[[nodiscard]] inline std::string cache_configuration(const Options &options, std::string_view compiler) {
+    std::string configuration(compiler);
+    configuration += ";O" + std::to_string(options.opt_level);
+    configuration += ";regs=" + std::to_string(options.num_regs);
+    configuration += options.backend == Backend::builtin ? ";builtin" : ";nasm";
+    configuration += options.emit_ir ? ";ir" : "";
+    configuration += options.emit_asm ? ";asm" : "";
+    return configuration;
+}
+
+inline void print_usage() {
+    std::cerr << "Incorrect usage. Correct usage is..." << std::endl;
+    std::cerr << "cosmolingua [options] <input.cl>" << std::endl;
+    std::cerr << "cosmolingua [options] -   (read the program from stdin)" << std::endl;
+    std::cerr << "cosmolingua [options] --batch <input.cl>... [--manifest=FILE]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --stream   Tokenize while parsing (constant token memory)" << std::endl;
+    std::cerr << "  -O0..-O2   Optimisation level (default -O" << max_opt_level
+              << "); -O0 still uses shifts, lea and magic numbers for * and / by constants" << std::endl;
+    std::cerr << "  --emit-ir  Write the intermediate representation to output.ir" << std::endl;
+    std::cerr << "  --regs=N   Registers available to the generator (1-" << allocatable_regs.size() << ")"
+              << std::endl;
+    std::cerr << "  --backend=builtin|nasm  Encode the executable directly (default) or via nasm and ld"
+              << std::endl;
+    std::cerr << "  --emit-asm Write output.asm with the builtin backend too" << std::endl;
+    std::cerr << "  --time-report  Print time and memory per compiler phase to stderr" << std::endl;
+    std::cerr << "  --stats=json   Write per-phase statistics and counts to output.stats.json" << std::endl;
+    std::cerr << "  --log-level=LEVEL  Lowest level in the log file: process, info (default), log, success,"
+              << std::endl;
+    std::cerr << "                     warning, fatal or error" << std::endl;
+    std::cerr << "  --cache[=DIR]      Reuse the output of identical earlier builds (default ~/.cache/cosarch)"
+              << std::endl;
+    std::cerr << "  --cache-size=MB    Size limit of the cache (default 256)" << std::endl;
+    std::cerr << "  --batch            Compile each input to its own executable, in parallel" << std::endl;
+    std::cerr << "  --manifest=FILE    Batch inputs from FILE, one `input [output]` per line" << std::endl;
+    std::cerr << "  --jobs=N           Threads for batch mode (default: one per hardware thread)" << std::endl;
+}
+
+inline Options parse_options(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg == "--emit-ir") {
+            options.emit_ir = true;
+        } else if (arg == "--emit-asm") {
+            options.emit_asm = true;
+        } else if (arg == "--backend=builtin") {
+            options.backend = Backend::builtin;
+        } else if (arg == "--backend=nasm") {
+            options.backend = Backend::nasm;
+        } else if (arg.size() == 3 && arg.starts_with("-O") && arg[2] >= '0' && arg[2] <= '0' + max_opt_level) {
+            options.opt_level = arg[2] - '0';
+        } else if (arg == "--time-report") {
+            options.time_report = true;
+        } else if (arg == "--stats=json") {
+            options.stats_json = true;
+        } else if (arg.starts_with("--log-level=")) {
+            const std::optional<LogLevel> level = log_level_from_name(arg.substr(12));
+            if (!level.has_value()) {
+                print_usage();
+                Log::error(1948, "Argument: " + std::string(arg));
+            }
+            options.log_level = *level;
+        } else if (arg == "--cache") {
+            options.cache_dir = CompileCache::default_directory();
+        } else if (arg.starts_with("--cache=") && arg.size() > 8) {
+            options.cache_dir = std::filesystem::path(arg.substr(8));
+        } else if (arg.starts_with("--cache-size=")) {
+            const std::string_view value = arg.substr(13);
+            const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(),
+                                                   options.cache_megabytes);
+            if (ec != std::errc{} || end != value.data() + value.size() || options.cache_megabytes == 0) {
+                print_usage();
+                Log::error(1948, "Argument: " + std::string(arg));
+            }
+        } else if (arg == "--batch") {
+            options.batch = true;
+        } else if (arg.starts_with("--manifest=") && arg.size() > 11) {
+            options.manifest = arg.substr(11);
+            options.batch = true;
+        } else if (arg.starts_with("--jobs=")) {
+            const std::string_view value = arg.substr(7);
+            const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), options.jobs);
+            if (ec != std::errc{} || end != value.data() + value.size() || options.jobs == 0) {
+                print_usage();
+                Log::error(1948, "Argument: " + std::string(arg));
+            }
+        } else if (arg.starts_with("--regs=")) {
+            const std::string_view value = arg.substr(7);
+            const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), options.num_regs);
+            if (ec != std::errc{} || end != value.data() + value.size() || options.num_regs == 0
+                || options.num_regs > allocatable_regs.size()) {
+                print_usage();
+                Log::error(1948, "Argument: " + std::string(arg));
+            }
+        } else if (arg.starts_with("--")) {
+            print_usage();
+            Log::error(1948, "Argument: " + std::string(arg));
+        } else {
+            options.inputs.emplace_back(arg);
+        }
+    }
+    if (!options.batch && options.inputs.size() != 1) {
+        print_usage();
+        Log::error(1948, options.inputs.empty() ? "No input file" : "More than one input file, use --batch");
+    }
+    if (options.batch && options.inputs.empty() && options.manifest.empty()) {
+        print_usage();
+        Log::error(1948, "No input files");
+    }
+    return options;
+}
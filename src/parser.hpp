@@ -1,128 +1,74 @@
 #pragma once
 
-#include <variant>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
 
 #include "arena.hpp"
+#include "ast.hpp"
 #include "tokenization.hpp"
 
+class Parser {
+public:
+    // Every node consumes at least one token of its own, so the token count
+    // bounds the AST and the whole tree fits into the arena's first chunk.
+    // `src` is the text the tokens refer to.
+    inline explicit Parser(std::vector<Token> tokens, std::string_view src)
+            : m_tokens(std::move(tokens)), m_src(src), m_allocator(arena_size_for(m_tokens.size())),
+              m_stmt_stack(m_allocator), m_ast(m_allocator) {
+        // The open-scope stack never holds more statements than the program.
+        m_stmt_stack.reserve(m_tokens.size() / 2);
+        m_ast.reserve_for_tokens(m_tokens.size());
+    }
 
-struct NodeTermIntLit {
-    Token int_lit;
-};
-
-struct NodeTermIdent {
-    Token ident;
-};
-
-struct NodeExpr;
-
-struct NodeTermParen {
-    NodeExpr *expr;
-};
-
-struct NodeBinExprAdd {
-    NodeExpr *lhs;
-    NodeExpr *rhs;
-};
-
-struct NodeBinExprMulti {
-    NodeExpr *lhs;
-    NodeExpr *rhs;
-};
-
-struct NodeBinExprSub {
-    NodeExpr *lhs;
-    NodeExpr *rhs;
-};
-
-struct NodeBinExprDiv {
-    NodeExpr *lhs;
-    NodeExpr *rhs;
-};
-
-struct NodeBinExpr {
-    std::variant<NodeBinExprAdd *, NodeBinExprMulti *, NodeBinExprSub *, NodeBinExprDiv *> var;
-};
-
-struct NodeTerm {
-    std::variant<NodeTermIntLit *, NodeTermIdent *, NodeTermParen *> var;
-};
-
-struct NodeExpr {
-    std::variant<NodeTerm *, NodeBinExpr *> var;
-};
-
-struct NodeStmtExit {
-    NodeExpr *expr;
-};
-
-struct NodeStmtLet {
-    Token ident;
-    NodeExpr *expr;
-};
-
-struct NodeStmt;
-
-struct NodeScope {
-    std::vector<NodeStmt *> stmts;
-};
+    // Streaming mode: tokens are pulled from `tokenizer` on demand and only
+    // the lookahead window is kept, so token memory does not grow with the
+    // size of the program. `tokenizer` has to outlive the parser.
+    inline explicit Parser(Tokenizer &tokenizer)
+            : m_src(tokenizer.source()), m_tokenizer(&tokenizer), m_allocator(arena_size_for(tokenizer.source_size() / 8)),
+              m_stmt_stack(m_allocator), m_ast(m_allocator) {
+        m_stmt_stack.reserve(stmt_stack_reserve);
+        m_ast.reserve_for_tokens(tokenizer.source_size() / 8);
+    }
 
-struct NodeStmtIf {
-    NodeExpr *expr;
-    NodeScope *scope;
-};
+    // The Ast returned by parse_prog() lives in this parser's arena.
+    Parser(const Parser &) = delete;
 
-struct NodeStmt {
-    std::variant<NodeStmtExit *, NodeStmtLet *, NodeScope *, NodeStmtIf *> var;
-};
+    Parser &operator=(const Parser &) = delete;
 
-struct NodeProg {
-    std::vector<NodeStmt *> stmts;
-};
+    [[nodiscard]] inline ArenaAllocator::Stats arena_stats() const {
+        return m_allocator.stats();
+    }
 
-class Parser {
-public:
-    inline explicit Parser(std::vector<Token> tokens)
-            : m_tokens(std::move(tokens)), m_allocator(1024 * 1024 * 4) // 4 mb
-    {
+    // Tokens taken from the token vector or the tokenizer so far.
+    [[nodiscard]] inline size_t tokens_read() const {
+        return m_tokens_read;
     }
 
-    std::optional<NodeTerm *> parse_term() {
+    std::optional<NodeIndex> parse_term() {
         if (auto int_lit = try_consume(TokenType::int_lit)) {
-            auto term_int_lit = m_allocator.alloc<NodeTermIntLit>();
-            term_int_lit->int_lit = int_lit.value();
-            auto term = m_allocator.alloc<NodeTerm>();
-            term->var = term_int_lit;
-            return term;
+            return m_ast.add_int_lit(int_lit_value(int_lit->text(m_src)));
         } else if (auto ident = try_consume(TokenType::ident)) {
-            auto expr_ident = m_allocator.alloc<NodeTermIdent>();
-            expr_ident->ident = ident.value();
-            auto term = m_allocator.alloc<NodeTerm>();
-            term->var = expr_ident;
-            return term;
+            return m_ast.add({.tag = NodeTag::term_ident, .a = ident->ident, .b = ident->offset});
         } else if (auto open_paren = try_consume(TokenType::open_paren)) {
+            // Parentheses only group; they need no node of their own.
             auto expr = parse_expr();
             if (!expr.has_value()) {
                 Log::error(3956, "Expected expression. Paren Expression Error.");
             }
             try_consume(TokenType::close_paren, "Expected `)`");
-            auto term_paren = m_allocator.alloc<NodeTermParen>();
-            term_paren->expr = expr.value();
-            auto term = m_allocator.alloc<NodeTerm>();
-            term->var = term_paren;
-            return term;
+            return expr.value();
         } else {
             return {};
         }
     }
 
-    std::optional<NodeExpr *> parse_expr(int min_prec = 0) { // prec = precendence
-        std::optional<NodeTerm *> term_lhs = parse_term();
-        if (!term_lhs.has_value()) {
+    std::optional<NodeIndex> parse_expr(int min_prec = 0) { // prec = precendence
+        std::optional<NodeIndex> expr_lhs = parse_term();
+        if (!expr_lhs.has_value()) {
             return {};
         }
-        auto expr_lhs = m_allocator.alloc<NodeExpr>();
-        expr_lhs->var = term_lhs.value();
 
         while (true) {
             std::optional<Token> curr_tok = peek();
@@ -144,151 +90,168 @@ public:
                 Log::error(9983, "Unable to parse expression");
             }
 
-            auto expr = m_allocator.alloc<NodeBinExpr>();
-            auto expr_lhs_cache = m_allocator.alloc<NodeExpr>();
+            NodeTag tag;
             if (op.type == TokenType::plus) {
-                auto add = m_allocator.alloc<NodeBinExprAdd>();
-                expr_lhs_cache->var = expr_lhs->var;
-                add->lhs = expr_lhs_cache;
-                add->rhs = expr_rhs.value();
-                expr->var = add;
+                tag = NodeTag::bin_expr_add;
             } else if (op.type == TokenType::minus) {
-                auto sub = m_allocator.alloc<NodeBinExprSub>();
-                expr_lhs_cache->var = expr_lhs->var;
-                sub->lhs = expr_lhs_cache;
-                sub->rhs = expr_rhs.value();
-                expr->var = sub;
+                tag = NodeTag::bin_expr_sub;
             } else if (op.type == TokenType::star) {
-                auto multi = m_allocator.alloc<NodeBinExprMulti>();
-                expr_lhs_cache->var = expr_lhs->var;
-                multi->lhs = expr_lhs_cache;
-                multi->rhs = expr_rhs.value();
-                expr->var = multi;
+                tag = NodeTag::bin_expr_multi;
             } else if (op.type == TokenType::fslash) {
-                auto div = m_allocator.alloc<NodeBinExprDiv>();
-                expr_lhs_cache->var = expr_lhs->var;
-                div->lhs = expr_lhs_cache;
-                div->rhs = expr_rhs.value();
-                expr->var = div;
+                tag = NodeTag::bin_expr_div;
             } else {
                 // Unreachable
                 Log::error(9984, "Unreachable: Invalid Binary Expression");
+                exit(EXIT_FAILURE);
             }
-            expr_lhs->var = expr;
+            expr_lhs = m_ast.add({.tag = tag, .a = expr_lhs.value(), .b = expr_rhs.value()});
         }
         return expr_lhs;
     }
 
-    std::optional<NodeScope *> parse_scope() {
+    std::optional<NodeIndex> parse_scope() {
         if (!try_consume(TokenType::open_curly).has_value()) {
             return {};
         }
 
-        // TODO: Checking if the code is usefully working
-        auto scope = m_allocator.alloc<NodeScope>();
-        /*while (peek().has_value() && peek().value().type != TokenType::close_curly) {
-            if (auto stmt = parse_stmt()) {
-                scope->stmts.push_back(stmt.value());
-            } else {
-                Log::error(2302,
-                           "Unclear statement. Probably accessing a variable that is not declared in the scope of the statement.");
-            }
-        }*/
-        while(auto stmt = parse_stmt()) {
-            scope->stmts.push_back(stmt.value());
+        // Statements of nested scopes are collected on the same stack; each
+        // scope moves its own slice into the AST when it closes.
+        const size_t stmts_begin = m_stmt_stack.size();
+        while (auto stmt = parse_stmt()) {
+            m_stmt_stack.push_back(stmt.value());
         }
         try_consume(TokenType::close_curly, "Expected `}`");
-        return scope;
+        const auto count = static_cast<uint32_t>(m_stmt_stack.size() - stmts_begin);
+        return m_ast.add({.tag = NodeTag::stmt_scope, .a = take_stmts(stmts_begin), .b = count});
     }
 
-    std::optional<NodeStmt *> parse_stmt() {
-        if (peek().value().type == TokenType::exit && peek(1).has_value()
+    std::optional<NodeIndex> parse_stmt() {
+        if (peek().has_value() && peek().value().type == TokenType::exit && peek(1).has_value()
             && peek(1).value().type == TokenType::open_paren) {
             consume();
             consume();
-            auto stmt_exit = m_allocator.alloc<NodeStmtExit>();
-            if (auto node_expr = parse_expr()) {
-                stmt_exit->expr = node_expr.value();
-            } else {
+            std::optional<NodeIndex> expr = parse_expr();
+            if (!expr.has_value()) {
                 Log::error(4568, "Invalid expression. Exit-Code Paran Expression Error");
             }
             try_consume(TokenType::close_paren, "Expected `)`");
             try_consume(TokenType::semi, "Expected `;`");
-            auto stmt = m_allocator.alloc<NodeStmt>();
-            stmt->var = stmt_exit;
-            return stmt;
+            return m_ast.add({.tag = NodeTag::stmt_exit, .a = expr.value()});
         } else if (
                 peek().has_value() && peek().value().type == TokenType::let && peek(1).has_value()
                 && peek(1).value().type == TokenType::ident && peek(2).has_value()
                 && peek(2).value().type == TokenType::eq) {
             consume();
-            auto stmt_let = m_allocator.alloc<NodeStmtLet>();
-            stmt_let->ident = consume();
+            const Token ident = consume();
             consume();
-            if (auto expr = parse_expr()) {
-                stmt_let->expr = expr.value();
-            } else {
+            std::optional<NodeIndex> expr = parse_expr();
+            if (!expr.has_value()) {
                 Log::error(4569, "Invalid expression. Ident Error");
             }
             try_consume(TokenType::semi, "Expected `;`");
-            auto stmt = m_allocator.alloc<NodeStmt>();
-            stmt->var = stmt_let;
-            return stmt;
+            return m_ast.add({.tag = NodeTag::stmt_let, .a = expr.value(), .b = ident.ident, .c = ident.offset});
         } else if (peek().has_value() && peek().value().type == TokenType::open_curly) {
-            if(auto scope = parse_scope()) {
-                auto stmt = m_allocator.alloc<NodeStmt>();
-                stmt->var = scope.value();
-                return stmt;
+            if (auto scope = parse_scope()) {
+                return scope.value();
             } else {
                 Log::error(4572, "Invalid statement. Scope Error.");
             }
         } else if (auto if_ = try_consume(TokenType::if_)) {
             try_consume(TokenType::open_paren, "Expected `(`");
-            auto stmt_if = m_allocator.alloc<NodeStmtIf>();
-            if (auto expr = parse_expr()) {
-                stmt_if->expr = expr.value();
-            } else {
+            std::optional<NodeIndex> expr = parse_expr();
+            if (!expr.has_value()) {
                 Log::error(3957, "Unable to parse expression");
             }
             try_consume(TokenType::close_paren, "Expected `)`");
 
-            if (auto scope = parse_scope()) {
-                stmt_if->scope = scope.value();
-            } else {
+            std::optional<NodeIndex> scope = parse_scope();
+            if (!scope.has_value()) {
                 Log::error(4572, "Invalid statement. Scope is not valid.");
             }
-            auto stmt = m_allocator.alloc<NodeStmt>();
-            stmt->var = stmt_if;
-            return stmt;
+            return m_ast.add({.tag = NodeTag::stmt_if, .a = expr.value(), .b = scope.value()});
         } else {
             return {};
         }
         return {};
     }
 
-    std::optional<NodeProg> parse_prog() {
-        NodeProg prog;
+    std::optional<Ast> parse_prog() {
+        const size_t stmts_begin = m_stmt_stack.size();
         while (peek().has_value()) {
             if (auto stmt = parse_stmt()) {
-                prog.stmts.push_back(stmt.value());
+                m_stmt_stack.push_back(stmt.value());
             } else {
                 Log::error(2302, "Program contains invalid statement. Program generation failed.");
             }
         }
-        return prog;
+        const auto count = static_cast<uint32_t>(m_stmt_stack.size() - stmts_begin);
+        m_ast.set_prog(take_stmts(stmts_begin), count);
+        return std::move(m_ast);
     }
 
 private:
-    [[nodiscard]] inline std::optional<Token> peek(int offset = 0) const {
-        if (m_index + offset >= m_tokens.size()) {
-            return {};
-        } else {
-            return m_tokens.at(m_index + offset);
+    static constexpr size_t stmt_stack_reserve = 256;
+
+    static inline size_t arena_size_for(size_t num_tokens) {
+        const size_t stack_bytes = std::max(num_tokens / 2, stmt_stack_reserve) * sizeof(NodeIndex);
+        return std::max(Ast::bytes_for_tokens(num_tokens) + stack_bytes + 1024, ArenaAllocator::default_chunk_size);
+    }
+
+    // parse_stmt() looks at most three tokens ahead.
+    static constexpr size_t max_lookahead = 4;
+
+    [[nodiscard]] inline std::optional<Token> peek(int offset = 0) {
+        assert(offset < static_cast<int>(max_lookahead));
+        while (m_lookahead_size <= static_cast<size_t>(offset)) {
+            const std::optional<Token> token = pull();
+            if (!token.has_value()) {
+                return {};
+            }
+            m_lookahead[(m_lookahead_head + m_lookahead_size) % max_lookahead] = token.value();
+            m_lookahead_size++;
         }
+        return m_lookahead[(m_lookahead_head + offset) % max_lookahead];
     }
 
     inline Token consume() {
-        return m_tokens.at(m_index++);
+        if (!peek().has_value()) {
+            Log::error(1029, "Unexpected end of input");
+        }
+        const Token token = m_lookahead[m_lookahead_head];
+        m_lookahead_head = (m_lookahead_head + 1) % max_lookahead;
+        m_lookahead_size--;
+        return token;
+    }
+
+    // Value of a decimal literal. Like the assembler, literals wider than 64
+    // bits keep their low 64 bits.
+    static inline uint64_t int_lit_value(std::string_view digits) {
+        uint64_t value = 0;
+        for (const char digit: digits) {
+            value = value * 10 + static_cast<uint64_t>(digit - '0');
+        }
+        return value;
+    }
+
+    // Moves the statements pushed since `begin` into the AST's list storage.
+    inline uint32_t take_stmts(size_t begin) {
+        const uint32_t first = m_ast.add_list({m_stmt_stack.data() + begin, m_stmt_stack.size() - begin});
+        m_stmt_stack.truncate(begin);
+        return first;
+    }
+
+    // Next token from the tokenizer (streaming) or the token vector.
+    inline std::optional<Token> pull() {
+        if (m_tokenizer != nullptr) {
+            std::optional<Token> token = m_tokenizer->next();
+            m_tokens_read += token.has_value();
+            return token;
+        }
+        if (m_index < m_tokens.size()) {
+            m_tokens_read++;
+            return m_tokens[m_index++];
+        }
+        return {};
     }
 
     inline Token try_consume(TokenType type, const std::string &err_msg) {
@@ -309,6 +272,15 @@ private:
     }
 
     const std::vector<Token> m_tokens;
+    const std::string_view m_src;
     size_t m_index = 0;
+    size_t m_tokens_read = 0;
+    Tokenizer *m_tokenizer = nullptr;
+    std::array<Token, max_lookahead> m_lookahead{};
+    size_t m_lookahead_head = 0;
+    size_t m_lookahead_size = 0;
     ArenaAllocator m_allocator;
+    // Statements of all scopes that are still open, innermost last.
+    ArenaVector<NodeIndex> m_stmt_stack;
+    Ast m_ast;
 };
\ No newline at end of file
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "instruction.hpp"
+
+// Window rewrites over the generator's instruction list (-O2). The rules
+// below run repeatedly until none of them applies any more:
+//
+//   self_move      mov r, r                       -> (removed)
+//   push_pop       push a; pop b                  -> mov b, a  (or nothing if a == b)
+//   zero_add       add/sub r, 0                   -> (removed)
+//   mov_zero       mov r, 0                       -> xor r32, r32
+//   dead_store     mov/add/sub/imul/shl/shr/lea/xor r, x  with r dead after
+//                                                 -> (removed)
+//   forward_move   mov t, x; mov d, t  with t dead after -> mov d, x
+//   unreachable    code after exit or jmp up to the next label -> (removed)
+//
+// Register liveness comes from one backward pass: the generator only jumps
+// forward and every syscall it emits is exit, so each label is visited before
+// the jumps to it. Flags are only read by the jz right after a test, which is
+// why dropping or rewriting other flag-setting instructions is safe.
+class Peephole {
+public:
+    enum class Rule : uint8_t {
+        self_move,
+        push_pop,
+        zero_add,
+        mov_zero,
+        dead_store,
+        forward_move,
+        unreachable,
+    };
+
+    static constexpr size_t rule_count = 7;
+
+    static constexpr std::array<std::string_view, rule_count> rule_names = {
+            "self_move", "push_pop", "zero_add", "mov_zero", "dead_store", "forward_move", "unreachable"
+    };
+
+    struct Stats {
+        std::array<size_t, rule_count> hits{};
+        size_t instrs_before = 0;
+        size_t instrs_after = 0;
+    };
+
+    // Rewrites `code` in place.
+    inline Stats run(std::vector<Instr> &code) {
+        m_stats = {};
+        m_stats.instrs_before = code.size();
+        while (pass(code)) {
+        }
+        m_stats.instrs_after = code.size();
+        return m_stats;
+    }
+
+private:
+    // Registers as a bit set indexed by Reg.
+    using RegSet = uint32_t;
+
+    static inline RegSet bit(Reg reg) {
+        return RegSet{1} << static_cast<unsigned>(reg);
+    }
+
+    static inline RegSet reads_of(const Operand &operand) {
+        if (operand.kind == Operand::Kind::reg) {
+            return bit(operand.reg);
+        }
+        if (operand.kind == Operand::Kind::address) {
+            return bit(operand.reg) | bit(operand.index);
+        }
+        return operand.kind == Operand::Kind::stack ? bit(Reg::rsp) : 0;
+    }
+
+    // Instructions without effects beyond their destination and the flags.
+    static inline bool is_alu(Opcode op) {
+        return op == Opcode::mov || op == Opcode::add || op == Opcode::sub || op == Opcode::imul
+               || op == Opcode::shl || op == Opcode::shr || op == Opcode::lea || op == Opcode::xor_;
+    }
+
+    static inline bool is_zero_idiom(const Instr &instr) {
+        return instr.op == Opcode::xor_ && instr.dst == instr.src;
+    }
+
+    // Registers `instr` reads and writes.
+    static inline RegSet uses(const Instr &instr) {
+        switch (instr.op) {
+            case Opcode::mov:
+            case Opcode::lea:
+                return reads_of(instr.src) | (instr.dst.kind == Operand::Kind::stack ? bit(Reg::rsp) : 0);
+            case Opcode::add:
+            case Opcode::sub:
+            case Opcode::imul:
+            case Opcode::shl:
+            case Opcode::shr:
+            case Opcode::xor_:
+            case Opcode::test:
+                return is_zero_idiom(instr) ? 0 : reads_of(instr.dst) | reads_of(instr.src);
+            case Opcode::div:
+                return bit(Reg::rax) | bit(Reg::rdx) | reads_of(instr.dst);
+            case Opcode::mul:
+                return bit(Reg::rax) | reads_of(instr.dst);
+            case Opcode::push:
+                return reads_of(instr.dst) | bit(Reg::rsp);
+            case Opcode::pop:
+                return bit(Reg::rsp);
+            case Opcode::syscall:
+                return bit(Reg::rax) | bit(Reg::rdi);
+            case Opcode::jz:
+            case Opcode::jmp:
+            case Opcode::label:
+                return 0;
+        }
+        std::unreachable();
+    }
+
+    static inline RegSet defs(const Instr &instr) {
+        switch (instr.op) {
+            case Opcode::mov:
+            case Opcode::add:
+            case Opcode::sub:
+            case Opcode::imul:
+            case Opcode::shl:
+            case Opcode::shr:
+            case Opcode::lea:
+            case Opcode::xor_:
+                return instr.dst.kind == Operand::Kind::reg ? bit(instr.dst.reg) : 0;
+            case Opcode::mul:
+            case Opcode::div:
+                return bit(Reg::rax) | bit(Reg::rdx);
+            case Opcode::pop:
+                return bit(instr.dst.reg) | bit(Reg::rsp);
+            case Opcode::push:
+                return bit(Reg::rsp);
+            default:
+                return 0;
+        }
+    }
+
+    // m_live_after[i]: registers read after instruction i before being
+    // written again.
+    void compute_liveness(std::span<const Instr> code) {
+        m_live_after.assign(code.size(), 0);
+        std::vector<RegSet> live_at_label;
+        RegSet live = 0;
+        for (size_t i = code.size(); i-- > 0;) {
+            const Instr &instr = code[i];
+            m_live_after[i] = live;
+            switch (instr.op) {
+                case Opcode::syscall:
+                    live = 0;
+                    break;
+                case Opcode::label:
+                    if (instr.label >= live_at_label.size()) {
+                        live_at_label.resize(instr.label + 1, 0);
+                    }
+                    live_at_label[instr.label] = live;
+                    break;
+                case Opcode::jz:
+                    live |= instr.label < live_at_label.size() ? live_at_label[instr.label] : 0;
+                    break;
+                case Opcode::jmp:
+                    live = instr.label < live_at_label.size() ? live_at_label[instr.label] : 0;
+                    break;
+                default:
+                    live &= ~defs(instr);
+                    break;
+            }
+            live |= uses(instr);
+        }
+    }
+
+    [[nodiscard]] bool is_live_after(size_t index, Reg reg) const {
+        return (m_live_after[index] & bit(reg)) != 0;
+    }
+
+    void hit(Rule rule) {
+        m_stats.hits[static_cast<size_t>(rule)]++;
+    }
+
+    // One sweep over `code`; returns whether anything changed.
+    bool pass(std::vector<Instr> &code) {
+        compute_liveness(code);
+        std::vector<Instr> out;
+        out.reserve(code.size());
+        bool changed = false;
+        bool reachable = true;
+        for (size_t i = 0; i < code.size(); ++i) {
+            Instr instr = code[i];
+            if (instr.op == Opcode::label) {
+                reachable = true;
+            } else if (!reachable) {
+                hit(Rule::unreachable);
+                changed = true;
+                continue;
+            }
+            const bool has_next = i + 1 < code.size();
+            const Instr *next = has_next ? &code[i + 1] : nullptr;
+
+            if (is_alu(instr.op) && instr.dst.kind == Operand::Kind::reg && !instr.dst.is_reg(Reg::rsp)
+                && !is_live_after(i, instr.dst.reg)) {
+                hit(Rule::dead_store);
+                changed = true;
+                continue;
+            }
+            if (instr.op == Opcode::mov && instr.dst.kind == Operand::Kind::reg) {
+                const Reg dst = instr.dst.reg;
+                if (instr.src.is_reg(dst)) {
+                    hit(Rule::self_move);
+                    changed = true;
+                    continue;
+                }
+                if (next != nullptr && next->op == Opcode::mov && next->src.is_reg(dst)
+                    && next->dst.kind == Operand::Kind::reg && !is_live_after(i + 1, dst)) {
+                    instr.dst = next->dst;
+                    out.push_back(instr);
+                    hit(Rule::forward_move);
+                    changed = true;
+                    ++i;
+                    continue;
+                }
+                if (instr.src.kind == Operand::Kind::imm && instr.src.imm == 0) {
+                    out.push_back(zero(dst));
+                    hit(Rule::mov_zero);
+                    changed = true;
+                    continue;
+                }
+            }
+            if ((instr.op == Opcode::add || instr.op == Opcode::sub) && instr.src.kind == Operand::Kind::imm
+                && instr.src.imm == 0) {
+                hit(Rule::zero_add);
+                changed = true;
+                continue;
+            }
+            if (instr.op == Opcode::push && next != nullptr && next->op == Opcode::pop) {
+                if (!(next->dst == instr.dst)) {
+                    out.push_back({.op = Opcode::mov, .dst = next->dst, .src = instr.dst});
+                }
+                hit(Rule::push_pop);
+                changed = true;
+                ++i;
+                continue;
+            }
+            if (instr.op == Opcode::syscall || instr.op == Opcode::jmp) {
+                reachable = false;
+            }
+            out.push_back(instr);
+        }
+        code = std::move(out);
+        return changed;
+    }
+
+    Stats m_stats;
+    std::vector<RegSet> m_live_after;
+};
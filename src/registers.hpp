@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// x86-64 general purpose registers, numbered like their machine encoding.
+enum class Reg : uint8_t {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+inline constexpr std::array<std::string_view, 16> reg_names = {
+        "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+inline std::string_view reg_name(Reg reg) {
+    return reg_names[static_cast<size_t>(reg)];
+}
+
+inline constexpr std::array<std::string_view, 16> reg_names32 = {
+        "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+        "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+
+inline std::string_view reg_name32(Reg reg) {
+    return reg_names32[static_cast<size_t>(reg)];
+}
+
+// Registers the allocator may hand out, in order of preference. rax and rdx
+// stay out: they are the fixed operands of div and of the exit syscall.
+// rsp is the stack pointer. Programs make no calls, so callee-saved
+// registers are as free as the rest.
+inline constexpr std::array<Reg, 13> allocatable_regs = {
+        Reg::rbx, Reg::rcx, Reg::rsi, Reg::rdi, Reg::r8, Reg::r9, Reg::r10,
+        Reg::r11, Reg::r12, Reg::r13, Reg::r14, Reg::r15, Reg::rbp
+};
+
+// Free list over the first `size` registers of `allocatable_regs`.
+class RegisterPool {
+public:
+    inline explicit RegisterPool(size_t size = allocatable_regs.size()) {
+        for (size_t i = 0; i < size && i < allocatable_regs.size(); ++i) {
+            m_free |= 1u << static_cast<unsigned>(allocatable_regs[i]);
+        }
+    }
+
+    inline std::optional<Reg> alloc() {
+        for (const Reg reg: allocatable_regs) {
+            if (m_free & (1u << static_cast<unsigned>(reg))) {
+                m_free &= ~(1u << static_cast<unsigned>(reg));
+                return reg;
+            }
+        }
+        return {};
+    }
+
+    // Allocates `reg` itself if it is free.
+    inline bool take(Reg reg) {
+        if (!is_free(reg)) {
+            return false;
+        }
+        m_free &= ~(1u << static_cast<unsigned>(reg));
+        return true;
+    }
+
+    [[nodiscard]] inline bool is_free(Reg reg) const {
+        return (m_free & (1u << static_cast<unsigned>(reg))) != 0;
+    }
+
+    inline void release(Reg reg) {
+        m_free |= 1u << static_cast<unsigned>(reg);
+    }
+
+    [[nodiscard]] inline size_t num_free() const {
+        return static_cast<size_t>(std::popcount(m_free));
+    }
+
+private:
+    uint32_t m_free = 0;
+};
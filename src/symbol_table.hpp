@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "interner.hpp"
+
+// Scoped symbol table for the generator, keyed by interned identifier. Each
+// binding carries a `Value` describing where the variable lives.
+//
+// Bindings live on one stack. `m_innermost[id]` points at the innermost
+// visible binding of `id` and every binding remembers the one it shadows, so
+// lookup is a single array access. A scope is a marker into the binding
+// stack; leaving it truncates the stack back to the marker and re-exposes
+// the shadowed bindings of only the names that scope declared.
+template<typename Value>
+class SymbolTable {
+public:
+    // `num_names` is the interner's size; ids beyond it are still accepted.
+    inline explicit SymbolTable(size_t num_names = 0)
+            : m_innermost(num_names, no_binding) {
+    }
+
+    // Result of declare(): false when the name already exists in the
+    // innermost scope. Shadowing a name of an enclosing scope is allowed.
+    inline bool declare(IdentId id, const Value &value) {
+        if (id >= m_innermost.size()) {
+            m_innermost.resize(id + 1, no_binding);
+        }
+        const uint32_t shadowed = m_innermost[id];
+        if (shadowed != no_binding && shadowed >= scope_begin()) {
+            return false;
+        }
+        m_innermost[id] = static_cast<uint32_t>(m_bindings.size());
+        m_bindings.push_back({.id = id, .value = value, .shadowed = shadowed});
+        return true;
+    }
+
+    [[nodiscard]] inline const Value *lookup(IdentId id) const {
+        if (id >= m_innermost.size() || m_innermost[id] == no_binding) {
+            return nullptr;
+        }
+        return &m_bindings[m_innermost[id]].value;
+    }
+
+    inline void begin_scope() {
+        m_scope_marks.push_back(static_cast<uint32_t>(m_bindings.size()));
+    }
+
+    // Leaves the innermost scope and returns how many bindings it declared.
+    // `on_exit` sees the value of each of them, innermost first.
+    template<typename OnExit>
+    inline size_t end_scope(OnExit &&on_exit) {
+        const uint32_t begin = scope_begin();
+        for (size_t i = m_bindings.size(); i > begin; --i) {
+            const Binding &binding = m_bindings[i - 1];
+            m_innermost[binding.id] = binding.shadowed;
+            on_exit(binding.value);
+        }
+        const size_t num_bindings = m_bindings.size() - begin;
+        m_bindings.resize(begin);
+        m_scope_marks.pop_back();
+        return num_bindings;
+    }
+
+    inline size_t end_scope() {
+        return end_scope([](const Value &) {});
+    }
+
+    // Bindings declared in the innermost scope so far.
+    [[nodiscard]] inline size_t scope_size() const {
+        return m_bindings.size() - scope_begin();
+    }
+
+    [[nodiscard]] inline size_t size() const {
+        return m_bindings.size();
+    }
+
+private:
+    static constexpr uint32_t no_binding = UINT32_MAX;
+
+    struct Binding {
+        IdentId id;
+        Value value;
+        uint32_t shadowed;
+    };
+
+    [[nodiscard]] inline uint32_t scope_begin() const {
+        return m_scope_marks.empty() ? 0 : m_scope_marks.back();
+    }
+
+    std::vector<Binding> m_bindings;
+    std::vector<uint32_t> m_innermost;
+    std::vector<uint32_t> m_scope_marks;
+};
@@ -1,8 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
+#include "interner.hpp"
 #include "utils/log.hpp"
+#include "utils/simd_scan.hpp"
 
 enum class TokenType {
     exit,
@@ -24,7 +34,7 @@ enum class TokenType {
     while_
 };
 
-std::optional<int> bin_prec(TokenType type) {
+inline std::optional<int> bin_prec(TokenType type) {
     switch (type) {
         case TokenType::plus:
         case TokenType::minus:
@@ -38,133 +48,287 @@ std::optional<int> bin_prec(TokenType type) {
 }
 
 
+// A token does not own its text. It only points into the source buffer,
+// which has to outlive the tokenizer, the parser and the generator.
+// Identifiers also carry their interned id, so later phases compare names by
+// integer and never look at the text again.
 struct Token {
     TokenType type;
-    std::optional<std::string> value{};
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    IdentId ident = 0;
+
+    [[nodiscard]] inline std::string_view text(std::string_view src) const {
+        return src.substr(offset, length);
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<Token>, "Tokens are copied freely by the parser");
+
+// Character classes of the lexer's start state. Every input byte is looked up
+// exactly once in `char_classes` to decide which scanner runs next.
+enum class CharClass : uint8_t {
+    invalid,
+    whitespace,
+    ident_start,
+    digit,
+    slash,
+    punct
 };
 
+struct KeywordEntry {
+    std::string_view text;
+    TokenType type;
+};
+
+struct PunctEntry {
+    char ch;
+    TokenType type;
+};
+
+// Adding a keyword or a single-character token only requires an entry here;
+// the character classes and the keyword hash are derived at compile time.
+inline constexpr KeywordEntry keyword_table[] = {
+        {"exit",  TokenType::exit},
+        {"let",   TokenType::let},
+        {"if",    TokenType::if_},
+        {"else",  TokenType::else_},
+        {"while", TokenType::while_},
+};
+
+inline constexpr PunctEntry punct_table[] = {
+        {'(', TokenType::open_paren},
+        {')', TokenType::close_paren},
+        {';', TokenType::semi},
+        {'=', TokenType::eq},
+        {'+', TokenType::plus},
+        {'*', TokenType::star},
+        {'-', TokenType::minus},
+        {'/', TokenType::fslash},
+        {'{', TokenType::open_curly},
+        {'}', TokenType::close_curly},
+};
+
+inline constexpr std::array<CharClass, 256> char_classes = [] {
+    std::array<CharClass, 256> table{};
+    for (const char c: std::string_view(" \t\n\v\f\r")) {
+        table[static_cast<uint8_t>(c)] = CharClass::whitespace;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        table[c] = CharClass::ident_start;
+        table[c - 'a' + 'A'] = CharClass::ident_start;
+    }
+    for (int c = '0'; c <= '9'; ++c) {
+        table[c] = CharClass::digit;
+    }
+    for (const PunctEntry &entry: punct_table) {
+        table[static_cast<uint8_t>(entry.ch)] = CharClass::punct;
+    }
+    // '/' may also start a comment, so it needs one byte of lookahead.
+    table['/'] = CharClass::slash;
+    return table;
+}();
+
+inline constexpr std::array<bool, 256> ident_continue = [] {
+    std::array<bool, 256> table{};
+    for (size_t c = 0; c < table.size(); ++c) {
+        table[c] = char_classes[c] == CharClass::ident_start || char_classes[c] == CharClass::digit;
+    }
+    return table;
+}();
+
+inline constexpr std::array<TokenType, 256> punct_types = [] {
+    std::array<TokenType, 256> table{};
+    for (const PunctEntry &entry: punct_table) {
+        table[static_cast<uint8_t>(entry.ch)] = entry.type;
+    }
+    return table;
+}();
+
+// Perfect hash over `keyword_table`: a multiplicative hash of the first byte,
+// the last byte and the length whose seed is searched at compile time so that
+// no two keywords share a slot. A lookup is one hash plus one comparison.
+inline constexpr size_t keyword_slot_bits = std::bit_width(std::size(keyword_table) * 2 - 1);
+inline constexpr size_t keyword_slot_count = size_t{1} << keyword_slot_bits;
+
+inline constexpr size_t keyword_max_length = [] {
+    size_t max_length = 0;
+    for (const KeywordEntry &entry: keyword_table) {
+        max_length = std::max(max_length, entry.text.size());
+    }
+    return max_length;
+}();
+
+constexpr uint32_t keyword_hash(std::string_view word, uint32_t seed) {
+    const uint32_t key = static_cast<uint8_t>(word.front())
+                         | static_cast<uint32_t>(static_cast<uint8_t>(word.back())) << 8
+                         | static_cast<uint32_t>(word.size()) << 16;
+    return (key * seed) >> (32 - keyword_slot_bits);
+}
+
+inline constexpr uint32_t keyword_seed = [] {
+    for (uint32_t seed = 0x9E3779B1u;; seed += 2) {
+        std::array<bool, keyword_slot_count> used{};
+        bool collision = false;
+        for (const KeywordEntry &entry: keyword_table) {
+            const uint32_t slot = keyword_hash(entry.text, seed);
+            collision = collision || used[slot];
+            used[slot] = true;
+        }
+        if (!collision) {
+            return seed;
+        }
+    }
+}();
+
+inline constexpr std::array<int8_t, keyword_slot_count> keyword_slots = [] {
+    std::array<int8_t, keyword_slot_count> slots{};
+    slots.fill(-1);
+    for (size_t i = 0; i < std::size(keyword_table); ++i) {
+        slots[keyword_hash(keyword_table[i].text, keyword_seed)] = static_cast<int8_t>(i);
+    }
+    return slots;
+}();
+
+constexpr TokenType classify_word(std::string_view word) {
+    if (word.size() > keyword_max_length) {
+        return TokenType::ident;
+    }
+    const int8_t index = keyword_slots[keyword_hash(word, keyword_seed)];
+    if (index >= 0 && keyword_table[index].text == word) {
+        return keyword_table[index].type;
+    }
+    return TokenType::ident;
+}
+
+static_assert(classify_word("while") == TokenType::while_);
+static_assert(classify_word("whale") == TokenType::ident);
+
 class Tokenizer {
 public:
-    inline explicit Tokenizer(std::string src)
-            : m_src(std::move(src)) {
+    // Identifiers are interned into `names`, which is shared with the parser
+    // and the generator of the same compilation. `scan_level` selects the
+    // whitespace/comment/run scanners. Every level produces the same token
+    // stream; lower levels exist for CPUs without AVX2 and for checking the
+    // vectorized kernels against the scalar ones.
+    inline explicit Tokenizer(std::string_view src, Interner &names, ScanLevel scan_level = best_scan_level())
+            : m_src(src), m_names(names), m_scan_level(supported_scan_level(scan_level)) {
+        if (m_src.length() > std::numeric_limits<uint32_t>::max()) {
+            Log::error(2055, "Source size: " + std::to_string(m_src.length()) + " bytes");
+        }
     }
 
+    // Lexes the whole remaining input at once.
     inline std::vector<Token> tokenize() {
-        std::vector<Token> tokens;
-        std::string buf;
-        while (peek().has_value()) {
-            if (std::isalpha(peek().value())) {
-                buf.push_back(consume());
-                while (peek().has_value() && std::isalnum(peek().value())) {
-                    buf.push_back(consume());
-                }
-                if (buf == "exit") {
-                    tokens.push_back({.type = TokenType::exit});
-                    buf.clear();
-                } else if (buf == "let") {
-                    tokens.push_back({.type = TokenType::let});
-                    buf.clear();
-                } else if (buf == "if") {
-                    tokens.push_back({.type = TokenType::if_});
-                    buf.clear();
-                } else if (buf == "else") {
-                    tokens.push_back({.type = TokenType::else_});
-                    buf.clear();
-                }else if (buf == "while") {
-                    tokens.push_back({.type = TokenType::while_});
-                    buf.clear();
-                } else {
-                    tokens.push_back({.type = TokenType::ident, .value = buf});
-                    buf.clear();
-                }
-            } else if (std::isdigit(peek().value())) {
-                buf.push_back(consume());
-                while (peek().has_value() && std::isdigit(peek().value())) {
-                    buf.push_back(consume());
-                }
-                tokens.push_back({.type = TokenType::int_lit, .value = buf});
-                buf.clear();
+        switch (m_scan_level) {
+#if COSARCH_SCAN_X86
+            case ScanLevel::avx2:
+                return tokenize_with<Avx2Scan>();
+            case ScanLevel::sse2:
+                return tokenize_with<Sse2Scan>();
+#endif
+            default:
+                return tokenize_with<ScalarScan>();
+        }
+    }
 
-            } else if (peek().value() == '/' && peek(1).has_value() && peek(1).value() == '/') {
-                while (peek().value() != '\n') {
-                    consume();
-                }
-            } else if (peek().value() == '/' && peek(1).has_value() && peek(1).value() == '*') {
-                consume();
-                while (!(peek().has_value() && peek(1).has_value() && peek().value() == '*' &&
-                         peek(1).value() == '/')) {
-                    consume();
-                    buf.push_back(peek().value());
-                    // Check if file ends before comment is closed
-                    if (!peek().has_value() || !peek(1).has_value()) {
-                        Log::error(1029, "Comment not closed");
-                    }
-                }
-                Log::addProcess("Comment: " + buf);
-                /* Check if file ends before comment is closed
-                if (peek().has_value() && peek(1).has_value()) {
-                    consume(); // Consume '*' at the end of the comment
-                    consume(); // Consume '/' to officially close the comment
-                }*/
-
-                // Comment must be closed
-                consume(); // Consume '*' at the end of the comment
-                consume(); // Consume '/' to officially close the comment
-                buf.clear();
-            } else if (peek().value() == '(') {
-                consume();
-                tokens.push_back({.type = TokenType::open_paren});
-            } else if (peek().value() == ')') {
-                consume();
-                tokens.push_back({.type = TokenType::close_paren});
-            } else if (peek().value() == ';') {
-                consume();
-                tokens.push_back({.type = TokenType::semi});
-            } else if (peek().value() == '=') {
-                consume();
-                tokens.push_back({.type = TokenType::eq});
-            } else if (peek().value() == '+') {
-                consume();
-                tokens.push_back({.type = TokenType::plus});
-            } else if (peek().value() == '*') {
-                consume();
-                tokens.push_back({.type = TokenType::star});
-            } else if (peek().value() == '-') {
-                consume();
-                tokens.push_back({.type = TokenType::minus});
-            } else if (peek().value() == '/') {
-                consume();
-                tokens.push_back({.type = TokenType::fslash});
-            } else if (peek().value() == '{') {
-                consume();
-                tokens.push_back({.type = TokenType::open_curly});
-            } else if (peek().value() == '}') {
-                consume();
-                tokens.push_back({.type = TokenType::close_curly});
-            } else if (std::isspace(peek().value()) || peek().value() == '\n' || peek().value() == '\r') {
-                consume();
-            } else {
-                Log::error(1029, "Char: " + std::string(1, peek().value()));
-                exit(EXIT_FAILURE);
-            }
+    // Pull interface: lexes only up to the next token, so a consumer that
+    // reads tokens one by one never holds more than it asked for.
+    inline std::optional<Token> next() {
+        switch (m_scan_level) {
+#if COSARCH_SCAN_X86
+            case ScanLevel::avx2:
+                return next_with<Avx2Scan>();
+            case ScanLevel::sse2:
+                return next_with<Sse2Scan>();
+#endif
+            default:
+                return next_with<ScalarScan>();
         }
-        m_index = 0;
-        return tokens;
+    }
+
+    [[nodiscard]] inline size_t source_size() const {
+        return m_src.size();
+    }
+
+    [[nodiscard]] inline std::string_view source() const {
+        return m_src;
     }
 
 private:
-    [[nodiscard]] inline std::optional<char> peek(int offset = 0) const {
-        if (m_index + offset >= m_src.length()) {
-            return {};
-        } else {
-            return m_src.at(m_index + offset);
+    template<typename Scan>
+    inline std::vector<Token> tokenize_with() {
+        std::vector<Token> tokens;
+        // Real programs average well over eight source bytes per token.
+        tokens.reserve((m_src.size() - m_index) / 8);
+        while (const std::optional<Token> token = next_with<Scan>()) {
+            tokens.push_back(token.value());
+        }
+        return tokens;
+    }
+
+    template<typename Scan>
+    inline std::optional<Token> next_with() {
+        const size_t size = m_src.size();
+        const char *const src = m_src.data();
+        const char *const end = src + size;
+        size_t i = m_index;
+        while (i < size) {
+            const size_t start = i;
+            switch (char_classes[static_cast<uint8_t>(src[i])]) {
+                case CharClass::whitespace:
+                    i = Scan::skip_whitespace(src + i + 1, end) - src;
+                    break;
+                case CharClass::ident_start: {
+                    i = Scan::ident_end(src + i + 1, end) - src;
+                    m_index = i;
+                    const std::string_view word = m_src.substr(start, i - start);
+                    Token token = make_token(classify_word(word), start, i);
+                    if (token.type == TokenType::ident) {
+                        token.ident = m_names.intern(word);
+                    }
+                    return token;
+                }
+                case CharClass::digit:
+                    i = Scan::digits_end(src + i + 1, end) - src;
+                    m_index = i;
+                    return make_token(TokenType::int_lit, start, i);
+                case CharClass::slash:
+                    if (i + 1 < size && src[i + 1] == '/') {
+                        i = Scan::find_newline(src + i + 2, end) - src;
+                    } else if (i + 1 < size && src[i + 1] == '*') {
+                        const char *close = Scan::find_comment_end(src + i + 2, end);
+                        if (close == end) {
+                            Log::error(1029, "Comment not closed");
+                        }
+                        const size_t body = i + 2;
+                        i = close - src;
+                        Log::addProcess("Comment: ", m_src.substr(body, i - body));
+                        i += 2;
+                    } else {
+                        m_index = i + 1;
+                        return make_token(TokenType::fslash, start, m_index);
+                    }
+                    break;
+                case CharClass::punct:
+                    m_index = i + 1;
+                    return make_token(punct_types[static_cast<uint8_t>(src[start])], start, m_index);
+                case CharClass::invalid:
+                    Log::error(1029, "Char: " + std::string(1, src[i]));
+                    exit(EXIT_FAILURE);
+            }
         }
+        m_index = i;
+        return {};
     }
 
-    inline char consume() {
-        return m_src.at(m_index++);
+    [[nodiscard]] static inline Token make_token(TokenType type, size_t start, size_t end) {
+        return {.type = type, .offset = static_cast<uint32_t>(start),
+                .length = static_cast<uint32_t>(end - start)};
     }
 
-    const std::string m_src;
+    const std::string_view m_src;
+    Interner &m_names;
+    const ScanLevel m_scan_level;
     size_t m_index = 0;
 };
\ No newline at end of file
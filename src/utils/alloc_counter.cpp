@@ -0,0 +1,155 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The Windows C runtimes have no std::aligned_alloc(); their aligned blocks
+// come from _aligned_malloc() and must be released with _aligned_free().
+#if defined(_WIN32)
+#define COSARCH_HAS_ALIGNED_ALLOC 0
+
+#include <malloc.h>
+
+#else
+#define COSARCH_HAS_ALIGNED_ALLOC 1
+#endif
+
+namespace {
+    std::atomic<uint64_t> allocation_count = 0;
+    std::atomic<uint64_t> allocated_bytes = 0;
+    thread_local AllocationCounts thread_counts;
+
+    void count(std::size_t size) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+        ++thread_counts.count;
+        thread_counts.bytes += size;
+    }
+
+    void *allocate(std::size_t size) {
+        count(size);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void *allocate(std::size_t size, std::align_val_t alignment) {
+        count(size);
+        const auto align = static_cast<std::size_t>(alignment);
+#if COSARCH_HAS_ALIGNED_ALLOC
+        // aligned_alloc() wants a multiple of the alignment.
+        const std::size_t rounded = (size + align - 1) / align * align;
+        return std::aligned_alloc(align, rounded == 0 ? align : rounded);
+#else
+        return _aligned_malloc(size == 0 ? align : size, align);
+#endif
+    }
+
+    void release_aligned(void *memory) {
+#if COSARCH_HAS_ALIGNED_ALLOC
+        std::free(memory);
+#else
+        _aligned_free(memory);
+#endif
+    }
+}
+
+AllocationCounts allocation_counts() {
+    return {.count = allocation_count.load(std::memory_order_relaxed),
+            .bytes = allocated_bytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts thread_allocation_counts() {
+    return thread_counts;
+}
+
+void *operator new(std::size_t size) {
+    if (void *memory = allocate(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    if (void *memory = allocate(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    if (void *memory = allocate(size, alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void *memory = allocate(size, alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate(size, alignment);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept {
+    release_aligned(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept {
+    release_aligned(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept {
+    release_aligned(memory);
+}
+
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept {
+    release_aligned(memory);
+}
+
+void operator delete(void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+    release_aligned(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+    release_aligned(memory);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Global operator new is replaced in alloc_counter.cpp to count every heap
+// allocation of the process. Linking that file in is what enables counting;
+// without it both numbers stay zero.
+struct AllocationCounts {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// All threads of the process.
+[[nodiscard]] AllocationCounts allocation_counts();
+
+// The calling thread only.
+[[nodiscard]] AllocationCounts thread_allocation_counts();
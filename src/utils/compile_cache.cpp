@@ -0,0 +1,367 @@
+#include "compile_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COSARCH_HAS_FLOCK 1
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#else
+#define COSARCH_HAS_FLOCK 0
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Files in an entry are named by their suffix after this.
+    constexpr std::string_view entry_prefix = "output";
+
+    // XXH64: fast on long inputs, and its 64 bits make accidental
+    // collisions between the sources of one cache practically impossible.
+    constexpr uint64_t prime1 = 11400714785074694791ULL;
+    constexpr uint64_t prime2 = 14029467366897019727ULL;
+    constexpr uint64_t prime3 = 1609587929392839161ULL;
+    constexpr uint64_t prime4 = 9650029242287828579ULL;
+    constexpr uint64_t prime5 = 2870177450012600261ULL;
+
+    uint64_t read64(const char *p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t read32(const char *p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint64_t xxh_round(uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        return std::rotl(acc, 31) * prime1;
+    }
+
+    uint64_t merge(uint64_t acc, uint64_t value) {
+        acc ^= xxh_round(0, value);
+        return acc * prime1 + prime4;
+    }
+
+    uint64_t xxh64(std::string_view data, uint64_t seed) {
+        const char *p = data.data();
+        const char *const end = p + data.size();
+        uint64_t hash;
+        if (data.size() >= 32) {
+            std::array<uint64_t, 4> lanes = {seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+            for (; end - p >= 32; p += 32) {
+                for (size_t lane = 0; lane < lanes.size(); ++lane) {
+                    lanes[lane] = xxh_round(lanes[lane], read64(p + 8 * lane));
+                }
+            }
+            hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) +
+                   std::rotl(lanes[3], 18);
+            for (const uint64_t lane: lanes) {
+                hash = merge(hash, lane);
+            }
+        } else {
+            hash = seed + prime5;
+        }
+        hash += data.size();
+        for (; end - p >= 8; p += 8) {
+            hash ^= xxh_round(0, read64(p));
+            hash = std::rotl(hash, 27) * prime1 + prime4;
+        }
+        if (end - p >= 4) {
+            hash ^= read32(p) * prime1;
+            hash = std::rotl(hash, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            hash ^= static_cast<uint8_t>(*p) * prime5;
+            hash = std::rotl(hash, 11) * prime1;
+        }
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    void append_hex(std::string &out, uint64_t value) {
+        static constexpr char digits[] = "0123456789abcdef";
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            out += digits[(value >> shift) & 0xf];
+        }
+    }
+
+    // Exclusive lock on `<directory>/lock` for as long as it lives. Without
+    // flock() concurrent compilers may race, which at worst costs a rebuild.
+    class DirectoryLock {
+    public:
+        explicit DirectoryLock(const fs::path &directory) {
+#if COSARCH_HAS_FLOCK
+            m_fd = ::open((directory / "lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (m_fd >= 0 && ::flock(m_fd, LOCK_EX) != 0) {
+                ::close(m_fd);
+                m_fd = -1;
+            }
+#endif
+        }
+
+        DirectoryLock(const DirectoryLock &) = delete;
+
+        DirectoryLock &operator=(const DirectoryLock &) = delete;
+
+        ~DirectoryLock() {
+#if COSARCH_HAS_FLOCK
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+#endif
+        }
+
+    private:
+        int m_fd = -1;
+    };
+
+    [[nodiscard]] bool is_entry(const fs::directory_entry &entry) {
+        const std::string name = entry.path().filename().string();
+        return entry.is_directory() && name.size() == 32 &&
+               name.find_first_not_of("0123456789abcdef") == std::string::npos;
+    }
+
+    [[nodiscard]] uint64_t entry_size(const fs::path &entry) {
+        uint64_t bytes = 0;
+        std::error_code ec;
+        for (const fs::directory_entry &file: fs::directory_iterator(entry, ec)) {
+            const uint64_t size = file.file_size(ec);
+            bytes += ec ? 0 : size;
+        }
+        return bytes;
+    }
+}
+
+CompileCache::CompileCache(fs::path directory, uint64_t max_bytes) : m_directory(std::move(directory)),
+                                                                     m_max_bytes(max_bytes) {
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    if (ec) {
+        Log::addWarning("Cache disabled, cannot create ", m_directory.string(), ": ", ec.message());
+        m_usable = false;
+    }
+}
+
+fs::path CompileCache::default_directory() {
+    if (const char *dir = std::getenv("COSARCH_CACHE_DIR"); dir != nullptr && *dir != '\0') {
+        return dir;
+    }
+    if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir != nullptr && *dir != '\0') {
+        return fs::path(dir) / "cosarch";
+    }
+    if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        return fs::path(home) / ".cache" / "cosarch";
+    }
+    return ".cosarch-cache";
+}
+
+std::string CompileCache::compiler_identity() {
+#if defined(__linux__)
+    struct stat info{};
+    if (::stat("/proc/self/exe", &info) == 0) {
+        return std::to_string(info.st_size) + "@" + std::to_string(info.st_mtim.tv_sec) + "." +
+               std::to_string(info.st_mtim.tv_nsec);
+    }
+#endif
+    // Less precise: only changes when this file is recompiled.
+    return __DATE__ " " __TIME__;
+}
+
+std::string CompileCache::key(std::string_view source, std::string_view configuration) {
+    std::string key;
+    key.reserve(32);
+    append_hex(key, xxh64(source, 0));
+    append_hex(key, xxh64(configuration, 0));
+    return key;
+}
+
+bool CompileCache::restore(const std::string &key, const std::string &output) {
+    if (!m_usable) {
+        return false;
+    }
+    DirectoryLock lock(m_directory);
+    read_counters();
+    const fs::path entry = m_directory / key;
+    std::error_code ec;
+    bool hit = fs::is_directory(entry, ec);
+    if (hit) {
+        for (const fs::directory_entry &file: fs::directory_iterator(entry, ec)) {
+            // Replace rather than overwrite: the old file may be a hard link
+            // or still be executing.
+            const std::string name = file.path().filename().string();
+            if (!name.starts_with(entry_prefix)) {
+                continue;
+            }
+            const fs::path target = output + name.substr(entry_prefix.size());
+            fs::remove(target, ec);
+            if (!fs::copy_file(file.path(), target, ec)) {
+                hit = false;
+                break;
+            }
+        }
+        hit = hit && !ec;
+    }
+    if (hit) {
+        fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+        ++m_counters.hits;
+    } else {
+        ++m_counters.misses;
+    }
+    write_counters();
+    return hit;
+}
+
+void CompileCache::store(const std::string &key, const std::string &output,
+                         std::span<const std::string_view> suffixes) {
+    if (!m_usable) {
+        return;
+    }
+    std::error_code ec;
+    uint64_t bytes = 0;
+    for (const std::string_view suffix: suffixes) {
+        const uint64_t size = fs::file_size(output + std::string(suffix), ec);
+        bytes += ec ? 0 : size;
+    }
+    // It would only push out everything else and then itself.
+    if (bytes > m_max_bytes) {
+        Log::addInfo("Cache: ", key, " is larger than the cache, not stored");
+        return;
+    }
+
+    // Filled outside the lock; only publishing it needs one.
+    const fs::path temporary = m_directory / ("tmp." + key + "." + std::to_string(std::random_device()()));
+    fs::create_directory(temporary, ec);
+    for (const std::string_view suffix: suffixes) {
+        if (ec) {
+            break;
+        }
+        fs::copy_file(output + std::string(suffix), temporary / (std::string(entry_prefix) + std::string(suffix)),
+                      ec);
+    }
+    if (ec) {
+        Log::addWarning("Cache: cannot store ", key, ": ", ec.message());
+        fs::remove_all(temporary, ec);
+        return;
+    }
+
+    DirectoryLock lock(m_directory);
+    read_counters();
+    // Another compiler may have stored the same entry in the meantime.
+    fs::rename(temporary, m_directory / key, ec);
+    if (ec) {
+        fs::remove_all(temporary, ec);
+    } else {
+        ++m_counters.stores;
+        ++m_counters.entries;
+        m_counters.bytes += bytes;
+    }
+    if (m_counters.bytes > m_max_bytes) {
+        evict();
+    }
+    write_counters();
+}
+
+void CompileCache::evict() {
+    std::vector<std::pair<fs::file_time_type, fs::path>> entries;
+    std::error_code ec;
+    m_counters.entries = 0;
+    m_counters.bytes = 0;
+    for (const fs::directory_entry &entry: fs::directory_iterator(m_directory, ec)) {
+        if (is_entry(entry)) {
+            entries.emplace_back(entry.last_write_time(ec), entry.path());
+            ++m_counters.entries;
+            m_counters.bytes += entry_size(entry.path());
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    const uint64_t target = m_max_bytes - m_max_bytes / 4;
+    const uint64_t evictions = m_counters.evictions;
+    for (const auto &[time, path]: entries) {
+        if (m_counters.bytes <= target) {
+            break;
+        }
+        const uint64_t bytes = entry_size(path);
+        if (fs::remove_all(path, ec) != static_cast<std::uintmax_t>(-1) && !ec) {
+            m_counters.bytes -= std::min(bytes, m_counters.bytes);
+            --m_counters.entries;
+            ++m_counters.evictions;
+        }
+    }
+    Log::addInfo("Cache: ", m_counters.evictions - evictions, " entry(ies) evicted, ", m_counters.bytes,
+                 " byte(s) left");
+}
+
+void CompileCache::read_counters() {
+    m_counters = {};
+    std::ifstream file(m_directory / "stats");
+    std::string name;
+    uint64_t value = 0;
+    bool found = false;
+    while (file >> name >> value) {
+        found = true;
+        if (name == "hits") {
+            m_counters.hits = value;
+        } else if (name == "misses") {
+            m_counters.misses = value;
+        } else if (name == "stores") {
+            m_counters.stores = value;
+        } else if (name == "evictions") {
+            m_counters.evictions = value;
+        } else if (name == "entries") {
+            m_counters.entries = value;
+        } else if (name == "bytes") {
+            m_counters.bytes = value;
+        }
+    }
+    if (!found) {
+        // New cache, or the stats were deleted: recount what is there.
+        std::error_code ec;
+        for (const fs::directory_entry &entry: fs::directory_iterator(m_directory, ec)) {
+            if (is_entry(entry)) {
+                ++m_counters.entries;
+                m_counters.bytes += entry_size(entry.path());
+            }
+        }
+    }
+}
+
+void CompileCache::write_counters() const {
+    const fs::path path = m_directory / "stats";
+    const fs::path temporary = m_directory / "stats.tmp";
+    {
+        std::ofstream file(temporary);
+        file << "hits " << m_counters.hits << '\n'
+             << "misses " << m_counters.misses << '\n'
+             << "stores " << m_counters.stores << '\n'
+             << "evictions " << m_counters.evictions << '\n'
+             << "entries " << m_counters.entries << '\n'
+             << "bytes " << m_counters.bytes << '\n';
+    }
+    std::error_code ec;
+    fs::rename(temporary, path, ec);
+}
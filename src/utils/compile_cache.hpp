@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+// On-disk cache of build results, so an unchanged source compiled with the
+// same compiler and options is restored instead of rebuilt.
+//
+// An entry is a directory named by the key: the XXH64 hash of the source
+// bytes followed by that of the configuration string (compiler identity
+// plus every option that changes the output files). It holds copies of the
+// files the build wrote, named `output` followed by the suffix the file had
+// after the output path: `output`, `output.o`, `output.asm` and so on.
+// Entries are only ever published complete, by renaming a finished
+// temporary directory.
+//
+// Hits refresh the modification time of their entry; once the entries
+// exceed the size limit the least recently used ones are removed until a
+// quarter of the limit is free again. Hit, miss, store and eviction counts
+// and the total size are kept in `<directory>/stats`. All of this happens
+// under an exclusive lock on `<directory>/lock`, so concurrent compilers can
+// share a cache.
+//
+// The cache is best effort: when it cannot be used, a warning is logged and
+// the compiler builds as if it was disabled.
+class CompileCache {
+public:
+    struct Counters {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stores = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    CompileCache(std::filesystem::path directory, uint64_t max_bytes);
+
+    // $COSARCH_CACHE_DIR, else $XDG_CACHE_HOME/cosarch, else
+    // $HOME/.cache/cosarch, else .cosarch-cache in the working directory.
+    [[nodiscard]] static std::filesystem::path default_directory();
+
+    // Size and modification time of the running compiler executable, which
+    // change with every rebuild of it.
+    [[nodiscard]] static std::string compiler_identity();
+
+    [[nodiscard]] static std::string key(std::string_view source, std::string_view configuration);
+
+    // Copies the files of entry `key` to `output` followed by their suffix.
+    // False on a miss, and when the entry could not be restored completely.
+    bool restore(const std::string &key, const std::string &output);
+
+    // Saves `output` followed by each of `suffixes` as entry `key`, then
+    // evicts entries while the cache is over its limit.
+    void store(const std::string &key, const std::string &output, std::span<const std::string_view> suffixes);
+
+    // As of the last restore() or store().
+    [[nodiscard]] const Counters &counters() const {
+        return m_counters;
+    }
+
+    [[nodiscard]] bool usable() const {
+        return m_usable;
+    }
+
+private:
+    void read_counters();
+
+    void write_counters() const;
+
+    // Rescans the entries for their number and size, then removes the least
+    // recently used ones if they exceed the limit.
+    void evict();
+
+    std::filesystem::path m_directory;
+    uint64_t m_max_bytes;
+    bool m_usable = true;
+    Counters m_counters;
+};
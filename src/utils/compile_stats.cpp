@@ -0,0 +1,182 @@
+#include "compile_stats.hpp"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COSARCH_HAS_RUSAGE 1
+
+#include <sys/resource.h>
+
+#else
+#define COSARCH_HAS_RUSAGE 0
+#endif
+
+namespace {
+    double milliseconds(std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+}
+
+CompileStats::CompileStats(Scope scope) : m_scope(scope), m_start(sample()), m_phase_start(m_start) {
+}
+
+CompileStats::Sample CompileStats::sample() const {
+    Sample now;
+    now.wall = std::chrono::steady_clock::now();
+#if COSARCH_HAS_RUSAGE
+    timespec cpu{};
+    clock_gettime(m_scope == Scope::thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    now.cpu_ms = static_cast<double>(cpu.tv_sec) * 1e3 + static_cast<double>(cpu.tv_nsec) / 1e6;
+#else
+    now.cpu_ms = static_cast<double>(std::clock()) * 1e3 / CLOCKS_PER_SEC;
+#endif
+    now.allocations = m_scope == Scope::thread ? thread_allocation_counts() : allocation_counts();
+    return now;
+}
+
+std::optional<uint64_t> CompileStats::peak_rss_kb() const {
+    if (m_scope == Scope::thread) {
+        return std::nullopt;
+    }
+#if COSARCH_HAS_RUSAGE
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#else
+    return 0;
+#endif
+}
+
+void CompileStats::begin_phase(std::string_view name) {
+    m_phases.push_back({.name = name, .arena_high_water = std::nullopt});
+    m_in_phase = true;
+    m_phase_start = sample();
+}
+
+void CompileStats::end_phase(std::optional<uint64_t> arena_high_water) {
+    if (!m_in_phase) {
+        return;
+    }
+    const Sample now = sample();
+    Phase &phase = m_phases.back();
+    phase.wall_ms = milliseconds(now.wall - m_phase_start.wall);
+    phase.cpu_ms = now.cpu_ms - m_phase_start.cpu_ms;
+    phase.peak_rss_kb = peak_rss_kb();
+    phase.allocations = now.allocations.count - m_phase_start.allocations.count;
+    phase.allocated_bytes = now.allocations.bytes - m_phase_start.allocations.bytes;
+    phase.arena_high_water = arena_high_water;
+    phase.completed = true;
+    m_in_phase = false;
+}
+
+void CompileStats::set_count(std::string_view name, uint64_t value) {
+    for (auto &[existing, count]: m_counts) {
+        if (existing == name) {
+            count = value;
+            return;
+        }
+    }
+    m_counts.emplace_back(name, value);
+}
+
+CompileStats::Phase CompileStats::total() const {
+    const Sample now = sample();
+    return {.name = "total",
+            .wall_ms = milliseconds(now.wall - m_start.wall),
+            .cpu_ms = now.cpu_ms - m_start.cpu_ms,
+            .peak_rss_kb = peak_rss_kb(),
+            .allocations = now.allocations.count - m_start.allocations.count,
+            .allocated_bytes = now.allocations.bytes - m_start.allocations.bytes,
+            .arena_high_water = std::nullopt,
+            .completed = true};
+}
+
+void CompileStats::finish(int exit_code) {
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    if (m_in_phase) {
+        // end_phase() marks it completed; an interrupted phase is not.
+        end_phase();
+        m_phases.back().completed = false;
+    }
+    if (m_time_report) {
+        std::ostringstream report;
+        print_report(report, exit_code);
+        std::cerr << report.str() << std::flush;
+    }
+    if (m_json) {
+        std::ofstream file(m_json_path);
+        write_json(file, exit_code);
+    }
+}
+
+void CompileStats::print_report(std::ostream &out, int exit_code) const {
+    const auto row = [&](const Phase &phase) {
+        out << std::left << std::setw(14) << phase.name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(11) << phase.wall_ms << std::setw(11) << phase.cpu_ms << std::setw(12);
+        if (phase.peak_rss_kb.has_value()) {
+            out << *phase.peak_rss_kb;
+        } else {
+            out << "-";
+        }
+        out << std::setw(10) << phase.allocations << std::setw(13) << phase.allocated_bytes << std::setw(13);
+        if (phase.arena_high_water.has_value()) {
+            out << *phase.arena_high_water;
+        } else {
+            out << "-";
+        }
+        out << (phase.completed ? "" : "  (interrupted)") << '\n';
+    };
+
+    out << "===== Compilation time report" << (m_title.empty() ? "" : ": ") << m_title << " =====\n";
+    out << std::left << std::setw(14) << "phase" << std::right << std::setw(11) << "wall ms" << std::setw(11)
+        << "cpu ms" << std::setw(12) << "peak RSS KB" << std::setw(10) << "allocs" << std::setw(13) << "alloc bytes"
+        << std::setw(13) << "arena HWM" << '\n';
+    for (const Phase &phase: m_phases) {
+        row(phase);
+    }
+    row(total());
+    for (const auto &[name, count]: m_counts) {
+        out << name << ": " << count << '\n';
+    }
+    out << "exit code: " << exit_code << std::endl;
+}
+
+void CompileStats::write_json(std::ostream &out, int exit_code) const {
+    const auto object = [&](const Phase &phase, std::string_view indent) {
+        out << indent << "{\"name\": \"" << phase.name << "\", \"wall_ms\": " << phase.wall_ms << ", \"cpu_ms\": "
+            << phase.cpu_ms;
+        if (phase.peak_rss_kb.has_value()) {
+            out << ", \"peak_rss_kb\": " << *phase.peak_rss_kb;
+        }
+        out << ", \"allocations\": " << phase.allocations << ", \"allocated_bytes\": " << phase.allocated_bytes;
+        if (phase.arena_high_water.has_value()) {
+            out << ", \"arena_high_water\": " << *phase.arena_high_water;
+        }
+        out << ", \"completed\": " << (phase.completed ? "true" : "false") << "}";
+    };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"exit_code\": " << exit_code << ",\n  \"total\": ";
+    object(total(), "");
+    out << ",\n  \"phases\": [";
+    for (size_t i = 0; i < m_phases.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n");
+        object(m_phases[i], "    ");
+    }
+    out << "\n  ],\n  \"counts\": {";
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << m_counts[i].first << "\": " << m_counts[i].second;
+    }
+    out << "\n  }\n}\n";
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "alloc_counter.hpp"
+
+// Per-phase cost of one compilation: wall and CPU time, peak RSS, heap
+// allocations and, where an arena is involved, its high-water mark, plus
+// counts of what was produced (tokens, AST nodes, instructions, ...).
+// Reported as a table (--time-report) and as JSON (--stats=json).
+class CompileStats {
+public:
+    // What is measured: the whole process, or only the thread that uses the
+    // stats (for one compilation among several running at once). A thread
+    // has no peak RSS of its own, so that column stays empty.
+    enum class Scope {
+        process,
+        thread,
+    };
+
+    struct Phase {
+        std::string_view name;
+        double wall_ms = 0;
+        double cpu_ms = 0;
+        // Peak resident set size of the process at the end of the phase;
+        // none in thread scope.
+        std::optional<uint64_t> peak_rss_kb = std::nullopt;
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+        std::optional<uint64_t> arena_high_water;
+        // False for the phase an error ended.
+        bool completed = false;
+    };
+
+    explicit CompileStats(Scope scope = Scope::process);
+
+    // Phases do not nest; begin_phase() ends nothing by itself.
+    void begin_phase(std::string_view name);
+
+    void end_phase(std::optional<uint64_t> arena_high_water = std::nullopt);
+
+    void set_count(std::string_view name, uint64_t value);
+
+    // `title` names the table; the JSON document goes to `json_path`.
+    void enable(bool time_report, bool json, std::string json_path = "output.stats.json", std::string title = {}) {
+        m_time_report = time_report;
+        m_json = json;
+        m_json_path = std::move(json_path);
+        m_title = std::move(title);
+    }
+
+    // Closes a phase that an error interrupted and writes the enabled
+    // reports: the table to stderr in one piece, the JSON document to the
+    // path given to enable().
+    void finish(int exit_code);
+
+    void print_report(std::ostream &out, int exit_code) const;
+
+    void write_json(std::ostream &out, int exit_code) const;
+
+private:
+    struct Sample {
+        std::chrono::steady_clock::time_point wall;
+        double cpu_ms = 0;
+        AllocationCounts allocations;
+    };
+
+    [[nodiscard]] Sample sample() const;
+
+    [[nodiscard]] std::optional<uint64_t> peak_rss_kb() const;
+
+    [[nodiscard]] Phase total() const;
+
+    Scope m_scope;
+    Sample m_start;
+    Sample m_phase_start;
+    bool m_in_phase = false;
+    std::vector<Phase> m_phases;
+    std::vector<std::pair<std::string_view, uint64_t>> m_counts;
+    bool m_time_report = false;
+    bool m_json = false;
+    std::string m_json_path;
+    std::string m_title;
+    bool m_finished = false;
+};
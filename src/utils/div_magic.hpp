@@ -0,0 +1,47 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+// Multiplier and shift that replace unsigned 64-bit division by a constant
+// (Granlund & Montgomery, "Division by Invariant Integers using
+// Multiplication", in the formulation libdivide uses). With hi(x) the high
+// 64 bits of a 64x64-bit product:
+//
+//   add == false:  n / d == hi(multiplier * n) >> shift
+//   add == true:   t = hi(multiplier * n);  n / d == (((n - t) >> 1) + t) >> shift
+//
+// The second form stands in for a 65-bit multiplier.
+struct DivMagic {
+    uint64_t multiplier;
+    uint8_t shift;
+    bool add;
+};
+
+// `d` must be neither 0 nor a power of two; those divide by `div` or `shr`.
+inline DivMagic unsigned_div_magic(uint64_t d) {
+    const auto floor_log2 = static_cast<uint8_t>(63 - std::countl_zero(d));
+    // 2^(64 + floor_log2) / d, by long division of the 128-bit numerator.
+    // Its high word 2^floor_log2 is below d, so the quotient fits 64 bits.
+    uint64_t quotient = 0;
+    uint64_t rem = uint64_t{1} << floor_log2;
+    for (int bit = 63; bit >= 0; --bit) {
+        const bool carry = (rem >> 63) != 0;
+        rem <<= 1;
+        quotient <<= 1;
+        if (carry || rem >= d) {
+            rem -= d;
+            quotient |= 1;
+        }
+    }
+
+    if (d - rem < (uint64_t{1} << floor_log2)) {
+        return {.multiplier = quotient + 1, .shift = floor_log2, .add = false};
+    }
+    quotient += quotient;
+    const uint64_t twice_rem = rem + rem;
+    if (twice_rem >= d || twice_rem < rem) {
+        quotient += 1;
+    }
+    return {.multiplier = quotient + 1, .shift = floor_log2, .add = true};
+}
@@ -0,0 +1,154 @@
+#include "elf_writer.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "log.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COSARCH_HAS_CHMOD 1
+
+#include <sys/stat.h>
+
+#else
+#define COSARCH_HAS_CHMOD 0
+#endif
+
+namespace {
+    // Where the file is mapped; the traditional base ld uses as well.
+    constexpr uint64_t load_address = 0x400000;
+    constexpr uint64_t page_size = 0x1000;
+
+    constexpr size_t elf_header_size = 64;
+    constexpr size_t program_header_size = 56;
+    constexpr size_t section_header_size = 64;
+    constexpr size_t code_offset = elf_header_size + program_header_size;
+
+    // Section names: "", ".text", ".shstrtab".
+    constexpr char section_names[] = "\0.text\0.shstrtab";
+    constexpr uint32_t text_name = 1;
+    constexpr uint32_t shstrtab_name = 7;
+
+    class Buffer {
+    public:
+        void u8(uint8_t value) {
+            m_bytes.push_back(value);
+        }
+
+        void u16(uint16_t value) {
+            put(value, 2);
+        }
+
+        void u32(uint32_t value) {
+            put(value, 4);
+        }
+
+        void u64(uint64_t value) {
+            put(value, 8);
+        }
+
+        void bytes(const void *data, size_t size) {
+            const auto *begin = static_cast<const uint8_t *>(data);
+            m_bytes.insert(m_bytes.end(), begin, begin + size);
+        }
+
+        void align(size_t alignment) {
+            while (m_bytes.size() % alignment != 0) {
+                m_bytes.push_back(0);
+            }
+        }
+
+        [[nodiscard]] size_t size() const {
+            return m_bytes.size();
+        }
+
+        [[nodiscard]] const std::vector<uint8_t> &data() const {
+            return m_bytes;
+        }
+
+    private:
+        // ELF64 for x86-64 is little-endian.
+        void put(uint64_t value, int size) {
+            for (int i = 0; i < size; ++i) {
+                m_bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        std::vector<uint8_t> m_bytes;
+    };
+
+    void section_header(Buffer &out, uint32_t name, uint32_t type, uint64_t flags, uint64_t address,
+                        uint64_t offset, uint64_t size, uint64_t alignment) {
+        out.u32(name);
+        out.u32(type);
+        out.u64(flags);
+        out.u64(address);
+        out.u64(offset);
+        out.u64(size);
+        out.u32(0); // sh_link
+        out.u32(0); // sh_info
+        out.u64(alignment);
+        out.u64(0); // sh_entsize
+    }
+}
+
+void write_elf_executable(const std::string &path, std::span<const uint8_t> code) {
+    const size_t names_offset = code_offset + code.size();
+    const size_t headers_offset = (names_offset + sizeof(section_names) + 7) / 8 * 8;
+    const size_t file_size = headers_offset + 3 * section_header_size;
+
+    Buffer out;
+    // ELF header
+    out.bytes("\x7f" "ELF", 4);
+    out.u8(2); // ELFCLASS64
+    out.u8(1); // ELFDATA2LSB
+    out.u8(1); // EV_CURRENT
+    out.u8(0); // ELFOSABI_SYSV
+    out.align(16);
+    out.u16(2);  // ET_EXEC
+    out.u16(62); // EM_X86_64
+    out.u32(1);  // EV_CURRENT
+    out.u64(load_address + code_offset); // e_entry
+    out.u64(elf_header_size);            // e_phoff
+    out.u64(headers_offset);             // e_shoff
+    out.u32(0);                          // e_flags
+    out.u16(elf_header_size);
+    out.u16(program_header_size);
+    out.u16(1); // e_phnum
+    out.u16(section_header_size);
+    out.u16(3); // e_shnum
+    out.u16(2); // e_shstrndx
+
+    // Program header: the whole file, readable and executable.
+    out.u32(1);     // PT_LOAD
+    out.u32(4 | 1); // PF_R | PF_X
+    out.u64(0);     // p_offset
+    out.u64(load_address);
+    out.u64(load_address);
+    out.u64(file_size); // p_filesz
+    out.u64(file_size); // p_memsz
+    out.u64(page_size);
+
+    out.bytes(code.data(), code.size());
+    out.bytes(section_names, sizeof(section_names));
+    out.align(8);
+
+    section_header(out, 0, 0, 0, 0, 0, 0, 0);
+    // SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR
+    section_header(out, text_name, 1, 2 | 4, load_address + code_offset, code_offset, code.size(), 1);
+    // SHT_STRTAB
+    section_header(out, shstrtab_name, 3, 0, 0, names_offset, sizeof(section_names), 1);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(out.data().data()), static_cast<std::streamsize>(out.size()));
+    if (!file) {
+        Log::error(2057, "File: " + path);
+    }
+    file.close();
+#if COSARCH_HAS_CHMOD
+    if (chmod(path.c_str(), 0755) != 0) {
+        Log::error(2057, "Cannot make " + path + " executable");
+    }
+#endif
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Writes `code` as a static x86-64 Linux executable: one read+execute
+// PT_LOAD segment covering the whole file, entry at the first code byte.
+// A `.text` section header is included so objdump and gdb can find the
+// code. Raises error 2057 when the file cannot be written.
+void write_elf_executable(const std::string &path, std::span<const uint8_t> code);
@@ -1,10 +1,17 @@
 #include "log.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
-#include <chrono>
-#include <fstream>
 
 
 std::unordered_map<int, std::string> Log::error_codes = {
@@ -15,6 +22,11 @@ std::unordered_map<int, std::string> Log::error_codes = {
         {1029, "Char parsing error."},
         {1948, "Invalid expression. Console Usage Error"},
         {2054, "Empty File"},
+        {2055, "Source file too large"},
+        {2056, "Unable to read source file"},
+        {2057, "Unable to write output file"},
+        {2058, "Unable to read batch manifest"},
+        {2059, "Output path used by more than one input"},
         {2301, "Invalid Program"},
         {2302, "Invalid statement"},
         {3956, "Expected expression. Paren Expression Error."},
@@ -25,37 +37,273 @@ std::unordered_map<int, std::string> Log::error_codes = {
         {4571, "Identifier already used"},
         {4572, "Scope is invalid"},
         {7768, "Not installed"},
+        {7770, "Unable to encode instruction"},
         {9983, "Unable to parse expression"},
         {9984, "Unreachable: Invalid Binary Expression"}
 };
 
-std::vector<Log::_log> Log::warnings;
-std::vector<Log::_log> Log::infos;
-std::vector<Log::_log> Log::log;
-std::vector<Log::_log> Log::fatal;
-std::vector<Log::_log> Log::errors;
-std::vector<Log::_log> Log::success;
-std::vector<Log::_log> Log::process;
-
-auto Log::getTimeInNS() {
-    auto now = std::chrono::system_clock::now();
-    auto nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()) % 1000000000;
-    return nowNs.count();
+LogLevel Log::threshold = LogLevel::info;
+bool Log::thread_safe_producers = false;
+std::function<void(int)> Log::exit_hook;
+
+namespace {
+    struct TemplateKeyHash {
+        size_t operator()(const LogTemplateKey &key) const {
+            size_t hash = std::hash<uint32_t>()(key.arg_mask | uint32_t{key.part_count} << 16);
+            for (size_t part = 0; part < key.part_count; ++part) {
+                hash = hash * 31 + std::hash<const void *>()(key.literals[part]);
+            }
+            return hash;
+        }
+    };
+
+    struct StringHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view text) const {
+            return std::hash<std::string_view>()(text);
+        }
+    };
+
+    // Owner of the log: records go into a ring buffer that is written to
+    // the file when the compiler exits. Only a log that fills the ring starts
+    // a writer thread, which drains it in the background from then on, so
+    // short compilations never pay for a thread.
+    class LogWriter {
+    public:
+        static constexpr uint64_t ring_capacity = uint64_t{1} << 14;
+
+        LogWriter()
+                : m_start(std::chrono::steady_clock::now()),
+                  m_start_unix(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count())) {
+        }
+
+        LogWriter(const LogWriter &) = delete;
+
+        LogWriter &operator=(const LogWriter &) = delete;
+
+        // A writer that already started a file completes it; otherwise
+        // nothing is written unless finish() was called.
+        ~LogWriter() {
+            stop_thread();
+            if (m_file != nullptr) {
+                drain();
+                write_end(EXIT_SUCCESS);
+            }
+        }
+
+        [[nodiscard]] uint64_t now() const {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - m_start).count());
+        }
+
+        [[nodiscard]] uint32_t message_id(const LogTemplateKey &key) {
+            if (const auto it = m_templates.find(key); it != m_templates.end()) {
+                return it->second;
+            }
+            std::string text;
+            for (size_t part = 0; part < key.part_count; ++part) {
+                text += (key.arg_mask >> part & 1) != 0 ? "{}" : key.literals[part];
+            }
+            const uint32_t id = intern(text);
+            m_templates.emplace(key, id);
+            return id;
+        }
+
+        [[nodiscard]] uint32_t intern(std::string_view text) {
+            if (const auto it = m_strings.find(text); it != m_strings.end()) {
+                return it->second;
+            }
+            const auto id = static_cast<uint32_t>(m_strings.size());
+            m_strings.emplace(std::string(text), id);
+            const std::lock_guard lock(m_mutex);
+            m_pending_strings.emplace_back(id, std::string(text));
+            return id;
+        }
+
+        void append(const LogFormat::Record &entry) {
+            if (m_ring == nullptr) {
+                m_ring = std::make_unique_for_overwrite<LogFormat::Record[]>(ring_capacity);
+            }
+            const uint64_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_tail.load(std::memory_order_acquire) == ring_capacity) {
+                make_room(head);
+            }
+            m_ring[head % ring_capacity] = entry;
+            m_head.store(head + 1, std::memory_order_release);
+        }
+
+        // Writes everything and the exit code; returns the file name.
+        std::string finish(int code) {
+            stop_thread();
+            drain();
+            write_end(code);
+            return m_path;
+        }
+
+    private:
+        void make_room(uint64_t head) {
+            std::unique_lock lock(m_mutex);
+            if (!m_thread.joinable()) {
+                m_thread = std::thread([this] { run(); });
+            }
+            m_wake.notify_one();
+            m_space.wait(lock, [&] {
+                return head - m_tail.load(std::memory_order_acquire) < ring_capacity;
+            });
+        }
+
+        void run() {
+            std::unique_lock lock(m_mutex);
+            while (true) {
+                m_wake.wait_for(lock, std::chrono::milliseconds(50), [&] {
+                    return m_stop || m_head.load(std::memory_order_acquire) -
+                                     m_tail.load(std::memory_order_relaxed) >= ring_capacity / 2;
+                });
+                const bool stop = m_stop;
+                lock.unlock();
+                drain();
+                lock.lock();
+                m_space.notify_all();
+                if (stop) {
+                    return;
+                }
+            }
+        }
+
+        void stop_thread() {
+            if (!m_thread.joinable()) {
+                return;
+            }
+            {
+                const std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_one();
+            m_thread.join();
+        }
+
+        // Writes the strings interned so far, then every record that was
+        // published before. Called by one thread at a time.
+        void drain() {
+            const uint64_t head = m_head.load(std::memory_order_acquire);
+            const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            std::vector<std::pair<uint32_t, std::string>> strings;
+            {
+                const std::lock_guard lock(m_mutex);
+                strings.swap(m_pending_strings);
+            }
+            open();
+            for (const auto &[id, text]: strings) {
+                put(LogFormat::Chunk::string);
+                put(id);
+                put(static_cast<uint32_t>(text.size()));
+                std::fwrite(text.data(), 1, text.size(), m_file);
+            }
+            // The pending records may wrap around the end of the ring.
+            uint64_t next = tail;
+            while (next != head) {
+                const uint64_t begin = next % ring_capacity;
+                const uint64_t count = std::min(head - next, ring_capacity - begin);
+                put(LogFormat::Chunk::records);
+                put(static_cast<uint32_t>(count));
+                std::fwrite(&m_ring[begin], sizeof(LogFormat::Record), count, m_file);
+                next += count;
+            }
+            m_tail.store(head, std::memory_order_release);
+        }
+
+        void open() {
+            if (m_file != nullptr) {
+                return;
+            }
+            m_path = std::to_string(m_start_unix / 1000000) + ".cslog";
+            m_file = std::fopen(m_path.c_str(), "wb");
+            if (m_file == nullptr) {
+                std::cerr << "Unable to write log file " << m_path << std::endl;
+                m_file = std::fopen("/dev/null", "wb");
+            }
+            std::fwrite(LogFormat::magic, 1, sizeof(LogFormat::magic), m_file);
+            put(m_start_unix);
+        }
+
+        void write_end(int code) {
+            put(LogFormat::Chunk::end);
+            put(static_cast<int32_t>(code));
+            std::fclose(m_file);
+            m_file = nullptr;
+        }
+
+        template<typename Value>
+        void put(const Value &value) {
+            std::fwrite(&value, sizeof(value), 1, m_file);
+        }
+
+        const std::chrono::steady_clock::time_point m_start;
+        const uint64_t m_start_unix;
+
+        // Producer side.
+        std::unordered_map<LogTemplateKey, uint32_t, TemplateKeyHash> m_templates;
+        std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> m_strings;
+
+        std::unique_ptr<LogFormat::Record[]> m_ring;
+        std::atomic<uint64_t> m_head = 0;
+        std::atomic<uint64_t> m_tail = 0;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_space;
+        std::vector<std::pair<uint32_t, std::string>> m_pending_strings;
+        bool m_stop = false;
+        std::thread m_thread;
+
+        std::FILE *m_file = nullptr;
+        std::string m_path;
+    };
+
+    LogWriter writer;
+
+    // Serialises producers when Log::setThreadSafe() is on.
+    std::mutex producer_mutex;
+
+    [[nodiscard]] std::unique_lock<std::mutex> lock_producers(bool thread_safe) {
+        return thread_safe ? std::unique_lock(producer_mutex) : std::unique_lock<std::mutex>();
+    }
+
+    // Set by Log::ErrorScope for its thread.
+    thread_local std::string_view error_context;
+    thread_local bool errors_throw = false;
+
+    // One write, so lines of concurrent compilations do not interleave.
+    void print_error(const std::string &line) {
+        std::cerr << (error_context.empty() ? line : std::string(error_context) + ": " + line) + "\n" << std::flush;
+    }
+}
+
+Log::ErrorScope::ErrorScope(std::string_view context)
+        : m_previous_context(std::exchange(error_context, context)),
+          m_previous_throws(std::exchange(errors_throw, true)) {
+}
+
+Log::ErrorScope::~ErrorScope() {
+    error_context = m_previous_context;
+    errors_throw = m_previous_throws;
 }
 
 void Log::error(const std::string &msg) {
-    std::cerr << "Error: " << msg << std::endl;
+    print_error("Error: " + msg);
     addError("Error by String", EXIT_FAILURE, "Error msg: " + msg);
 }
 
 void Log::error(const int code) {
 
     if (auto it = error_codes.find(code); it != error_codes.end()) {
-        std::cerr << "Error code " << code << ": " << it->second << std::endl;
+        print_error("Error code " + std::to_string(code) + ": " + it->second);
         addError("Error code: ", code, it->second);
     }
 
-    std::cerr << "Unknown error code: " << code << std::endl;
+    print_error("Unknown error code: " + std::to_string(code));
     addError("Unknown Error code", 12, "Unknown error code: " + std::to_string(code));
 }
 
@@ -63,154 +311,45 @@ void Log::error(const int code, const std::string &additionalMsg) {
     //system("ipl -i -c --exit");
 
     if (auto it = error_codes.find(code); it != error_codes.end()) {
-        std::cerr << "Error code " << code << ": " << it->second << ". " << additionalMsg << std::endl;
+        print_error("Error code " + std::to_string(code) + ": " + it->second + ". " + additionalMsg);
         addError(additionalMsg, code, it->second);
     }
 
-    std::cerr << "Unknown error code: " << code << ". " << additionalMsg << std::endl;
+    print_error("Unknown error code: " + std::to_string(code) + ". " + additionalMsg);
     addError("Unknown Error code: " + std::to_string(code) + ". " + additionalMsg, 12, "Unknown error code: " + std::to_string(code));
 }
 
-void Log::add(const std::string &msg) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.type = "Log";
-    log.push_back(log_entry);
+void Log::push(const LogTemplateKey &key, LogFormat::Record &entry) {
+    const std::unique_lock lock = lock_producers(thread_safe_producers);
+    entry.time = writer.now();
+    entry.message = writer.message_id(key);
+    writer.append(entry);
 }
 
-void Log::addSuccess(const std::string &msg) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.type = "Success";
-    success.push_back(log_entry);
-}
-
-void Log::addProcess(const std::string &msg) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.type = "Process";
-    process.push_back(log_entry);
-}
-
-void Log::addWarning(const std::string &msg) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.type = "Warning";
-    warnings.push_back(log_entry);
-}
-
-void Log::addInfo(const std::string &msg) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.type = "Info";
-    infos.push_back(log_entry);
-}
-
-void Log::addFatal(const std::string &msg) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.type = "Fatal";
-    fatal.push_back(log_entry);
+uint32_t Log::intern(std::string_view text) {
+    const std::unique_lock lock = lock_producers(thread_safe_producers);
+    return writer.intern(text);
 }
 
 void Log::addError(const std::string &msg, const int code, const std::string &details) {
-    _log log_entry;
-    log_entry.time = getTimeInNS();
-    log_entry.msg = msg;
-    log_entry.details = details;
-    log_entry.code = code;
-    log_entry.type = "Error";
-    errors.push_back(log_entry);
-    createFile(code);
-}
-
-std::string cTime() {
-    auto now = std::chrono::system_clock::now();
-    auto nowAsTimeT = std::chrono::system_clock::to_time_t(now);
-    auto nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()) % 1000000000;
-
-    std::tm bt{};
-    localtime_s(&bt, &nowAsTimeT); // Use localtime_r(&bt, &nowAsTimeT) on Unix-like systems
-    std::ostringstream oss;
-
-    oss << std::put_time(&bt, "%Y-%m-%d %H:%M:%S");
-    oss << '.' << std::setfill('0') << std::setw(9) << nowNs.count();
-
-    return oss.str();
-}
-
-std::string cTime(long long ms) {
-    // Convert ms to a time_point
-    auto msDuration = std::chrono::milliseconds(ms);
-    auto tp = std::chrono::system_clock::time_point(msDuration);
-
-    // Convert to time_t for formatting
-    auto timeT = std::chrono::system_clock::to_time_t(tp);
-
-    // Extract milliseconds (since ms is already provided, no need to calculate)
-    auto milliseconds = ms % 1000;
-
-    std::tm bt{};
-    localtime_s(&bt, &timeT); // Use localtime_r(&bt, &timeT) on Unix-like systems
-    std::ostringstream oss;
-
-    oss << std::put_time(&bt, "%Y-%m-%d %H:%M:%S");
-    oss << '.' << std::setfill('0') << std::setw(3) << milliseconds;
-
-    return oss.str();
-}
-
-void Log::generatingLog(const int code) {
-    auto now = std::chrono::system_clock::now();
-    auto now_ms = time_point_cast<std::chrono::milliseconds>(now).time_since_epoch().count();
-    std::string filename = std::to_string(now_ms) + ".log";
-
-    std::ofstream file(filename);
-    file << "Log file generated at " << cTime() << std::endl;
-    file << "Warnings: " << warnings.size() << std::endl;
-    file << "Infos: " << infos.size() << std::endl;
-    file << "Error: " << errors.size() << std::endl;
-    file << "Fatal: " << fatal.size() << std::endl;
-    file << "Log: " << log.size() << std::endl;
-    file << "Success: " << success.size() << std::endl;
-    file << "Process: " << process.size() << std::endl;
-
-    // Create a single vector and sort it by time
-    std::vector<_log> all_logs;
-    all_logs.insert(all_logs.end(), warnings.begin(), warnings.end());
-    all_logs.insert(all_logs.end(), infos.begin(), infos.end());
-    all_logs.insert(all_logs.end(), errors.begin(), errors.end());
-    all_logs.insert(all_logs.end(), fatal.begin(), fatal.end());
-    all_logs.insert(all_logs.end(), log.begin(), log.end());
-    all_logs.insert(all_logs.end(), success.begin(), success.end());
-    all_logs.insert(all_logs.end(), process.begin(), process.end());
-
-    std::sort(all_logs.begin(), all_logs.end(), [](const _log &a, const _log &b) {
-        return a.time < b.time;
-    });
-
-    for (const auto &log_entry: all_logs) {
-        file << cTime() << " " << log_entry.time << ": " << log_entry.type << ": " << log_entry.msg  << "  " << log_entry.code << std::endl;
+    record<LogLevel::error>(code, msg, " (", details, ")");
+    if (errors_throw) {
+        throw CompileError(code);
     }
-
-    file << "Exit code: " << code << std::endl;
-
-    file.close();
-    std::cout << "Log file generated at " << filename << std::endl;
+    createFile(code);
 }
 
 void Log::createFile() {
-    generatingLog(EXIT_SUCCESS);
-    exit(EXIT_SUCCESS);
+    createFile(EXIT_SUCCESS);
 }
 
 void Log::createFile(const int code) {
-    generatingLog(code);
+    if (exit_hook) {
+        // An error inside the hook must not run it again.
+        const std::function<void(int)> hook = std::exchange(exit_hook, nullptr);
+        hook(code);
+    }
+    const std::string path = writer.finish(code);
+    std::cout << "Log file generated at " << path << std::endl;
     exit(code);
-} // Private
\ No newline at end of file
+}
\ No newline at end of file
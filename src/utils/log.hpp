@@ -1,48 +1,233 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <unordered_map>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include <ctime>
 
+#include "log_format.hpp"
+
+// Severity of a log entry, lowest first. `process` traces individual
+// compiler steps and is the only level recorded from hot paths.
+enum class LogLevel : uint8_t {
+    process,
+    info,
+    log,
+    success,
+    warning,
+    fatal,
+    error,
+};
+
+inline constexpr std::string_view log_level_names[] = {
+        "process", "info", "log", "success", "warning", "fatal", "error",
+};
+
+[[nodiscard]] inline std::optional<LogLevel> log_level_from_name(std::string_view name) {
+    for (size_t level = 0; level < std::size(log_level_names); ++level) {
+        if (log_level_names[level] == name) {
+            return static_cast<LogLevel>(level);
+        }
+    }
+    return std::nullopt;
+}
+
+// Levels below this are compiled out entirely (set with the
+// COSARCH_LOG_MIN_LEVEL CMake cache variable). Errors are always recorded.
+#ifndef COSARCH_LOG_MIN_LEVEL
+#define COSARCH_LOG_MIN_LEVEL 0
+#endif
+
+inline constexpr LogLevel compiled_log_level = static_cast<LogLevel>(
+        COSARCH_LOG_MIN_LEVEL < 6 ? COSARCH_LOG_MIN_LEVEL : 6);
+
+inline constexpr size_t log_max_parts = 12;
+
+// Message template of a log call: the string literal parts by address, and
+// which parts are arguments.
+struct LogTemplateKey {
+    std::array<const char *, log_max_parts> literals{};
+    uint16_t arg_mask = 0;
+    uint8_t part_count = 0;
+
+    bool operator==(const LogTemplateKey &) const = default;
+};
+
+// Thrown by Log::error() on a thread inside a Log::ErrorScope, instead of
+// exiting the process.
+class CompileError : public std::exception {
+public:
+    explicit CompileError(int code) : m_code(code) {
+    }
+
+    [[nodiscard]] int code() const {
+        return m_code;
+    }
+
+    [[nodiscard]] const char *what() const noexcept override {
+        return "compilation failed";
+    }
+
+private:
+    int m_code;
+};
 
 class Log {
 public:
+    // While one is alive, Log::error() on its thread records the error and
+    // throws CompileError rather than exiting, so a failed compilation in a
+    // batch does not take the others down. Messages on stderr are prefixed
+    // with `context`, which has to outlive the scope.
+    class ErrorScope {
+    public:
+        explicit ErrorScope(std::string_view context);
+
+        ErrorScope(const ErrorScope &) = delete;
+
+        ErrorScope &operator=(const ErrorScope &) = delete;
+
+        ~ErrorScope();
+
+    private:
+        std::string_view m_previous_context;
+        bool m_previous_throws;
+    };
+
     static void error(const std::string &msg);
     static void error(const int code);
     static void error(const int code, const std::string &additionalMsg);
-    static void add(const std::string &msg);
-    static void addWarning(const std::string &msg);
-    static void addInfo(const std::string &msg);
-    static void addProcess(const std::string &msg);
-    static void addFatal(const std::string &msg);
-    static void addSuccess(const std::string &msg);
+
+    // Each message is given as parts: string literals, other strings,
+    // characters or integers. Nothing is formatted while compiling; a
+    // suppressed call does not even read the clock.
+    template<typename... Parts>
+    static void add(const Parts &...parts) {
+        record<LogLevel::log>(0, parts...);
+    }
+
+    template<typename... Parts>
+    static void addWarning(const Parts &...parts) {
+        record<LogLevel::warning>(0, parts...);
+    }
+
+    template<typename... Parts>
+    static void addInfo(const Parts &...parts) {
+        record<LogLevel::info>(0, parts...);
+    }
+
+    template<typename... Parts>
+    static void addProcess(const Parts &...parts) {
+        record<LogLevel::process>(0, parts...);
+    }
+
+    template<typename... Parts>
+    static void addFatal(const Parts &...parts) {
+        record<LogLevel::fatal>(0, parts...);
+    }
+
+    template<typename... Parts>
+    static void addSuccess(const Parts &...parts) {
+        record<LogLevel::success>(0, parts...);
+    }
+
+    // Runtime threshold; entries below it are dropped. Defaults to `info`,
+    // so process tracing costs nothing unless asked for.
+    static void setLevel(LogLevel level) {
+        threshold = level;
+    }
+
+    [[nodiscard]] static bool enabled(LogLevel level) {
+        return level >= compiled_log_level && level >= threshold;
+    }
+
+    // Lets several threads log at once. Producers are then serialised by a
+    // mutex; a single-threaded compiler leaves this off and takes no lock.
+    // Must not change while other threads log.
+    static void setThreadSafe(bool thread_safe) {
+        thread_safe_producers = thread_safe;
+    }
+
+    // Runs before the log is written on every way out of the compiler,
+    // including errors; gets the exit code.
+    static void setExitHook(std::function<void(int)> hook) {
+        exit_hook = std::move(hook);
+    }
+
+    // Writes the log to `<start time in ms>.cslog` and exits with `code`.
+    // tools/log_decode.cpp turns the file back into text.
     static void createFile();
     static void createFile(const int code);
 
 private:
-    struct _log {
-        time_t time;
-        std::string msg;
-        std::string details;
-        int code;
-        int checkpoint;
-        std::string type;
-    };
+    template<typename Part>
+    static constexpr bool is_literal = std::is_array_v<Part> && std::is_same_v<std::remove_extent_t<Part>, char>;
 
-    static std::unordered_map<int, std::string> error_codes;
-    static std::vector<_log> warnings;
-    static std::vector<_log> infos;
-    static std::vector<_log> log;
-    static std::vector<_log> fatal;
-    static std::vector<_log> errors;
-    static std::vector<_log> success;
-    static std::vector<_log> process;
+    // All entries go into one time-ordered buffer of fixed-size records.
+    // String literal parts form the message template, interned once by the
+    // addresses of the literals; the other parts become arguments.
+    template<LogLevel level, typename... Parts>
+    static void record(int32_t code, const Parts &...parts) {
+        static_assert(sizeof...(Parts) <= log_max_parts, "too many log message parts");
+        static_assert((0 + ... + (is_literal<Parts> ? 0 : 1)) <= LogFormat::max_args,
+                      "too many log message arguments");
+        if constexpr (level >= compiled_log_level) {
+            if (level >= threshold) {
+                LogTemplateKey key{.part_count = sizeof...(Parts)};
+                LogFormat::Record entry{};
+                entry.level = static_cast<uint8_t>(level);
+                entry.code = code;
+                size_t index = 0;
+                (add_part(key, entry, index++, parts), ...);
+                push(key, entry);
+            }
+        }
+    }
 
+    template<typename Part>
+    static void add_part(LogTemplateKey &key, LogFormat::Record &entry, size_t index, const Part &part) {
+        if constexpr (is_literal<Part>) {
+            key.literals[index] = part;
+        } else {
+            key.arg_mask |= static_cast<uint16_t>(1u << index);
+            const size_t arg = entry.arg_count++;
+            if constexpr (std::is_convertible_v<const Part &, std::string_view>) {
+                entry.kinds[arg] = LogFormat::ArgKind::string;
+                entry.args[arg] = intern(std::string_view(part));
+            } else if constexpr (std::is_same_v<Part, char>) {
+                entry.kinds[arg] = LogFormat::ArgKind::character;
+                entry.args[arg] = static_cast<unsigned char>(part);
+            } else if constexpr (std::is_signed_v<Part>) {
+                static_assert(std::is_integral_v<Part>, "log parts are strings, characters or integers");
+                entry.kinds[arg] = LogFormat::ArgKind::signed_int;
+                entry.args[arg] = static_cast<uint64_t>(static_cast<int64_t>(part));
+            } else {
+                static_assert(std::is_integral_v<Part>, "log parts are strings, characters or integers");
+                entry.kinds[arg] = LogFormat::ArgKind::unsigned_int;
+                entry.args[arg] = static_cast<uint64_t>(part);
+            }
+        }
+    }
 
-    static void addError(const std::string &msg, const int code, const std::string &details);
+    // Stamps the entry with the time and its template id and appends it.
+    static void push(const LogTemplateKey &key, LogFormat::Record &entry);
+
+    [[nodiscard]] static uint32_t intern(std::string_view text);
+
+    static LogLevel threshold;
 
-    static void generatingLog(const int code);
-    static auto getTimeInNS();
+    static bool thread_safe_producers;
+
+    static std::function<void(int)> exit_hook;
+
+    static std::unordered_map<int, std::string> error_codes;
+
+    static void addError(const std::string &msg, const int code, const std::string &details);
 };
\ No newline at end of file
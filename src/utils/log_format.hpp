@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// On-disk layout of the binary log written by Log and read back by
+// tools/log_decode.cpp. All integers are little-endian, as written by x86-64.
+//
+//   magic             8 bytes, "COSLOG" followed by the format version
+//   start             uint64, wall clock at the first entry in ns since the
+//                     Unix epoch; record times are relative to it
+//   chunk*            one byte of Chunk kind, then:
+//     string          uint32 id, uint32 size, `size` bytes of text
+//     records         uint32 count, `count` Records
+//     end             int32 exit code of the compiler; always last
+//
+// Message templates and string arguments share one table of interned
+// strings. A template contains one "{}" per argument of its records.
+namespace LogFormat {
+    inline constexpr char magic[8] = {'C', 'O', 'S', 'L', 'O', 'G', '\0', '\1'};
+
+    inline constexpr size_t max_args = 4;
+
+    enum class Chunk : uint8_t {
+        string = 1,
+        records = 2,
+        end = 3,
+    };
+
+    enum class ArgKind : uint8_t {
+        none,
+        unsigned_int,
+        signed_int,
+        character,
+        string,
+    };
+
+    struct Record {
+        // Nanoseconds since `start`, from a monotonic clock.
+        uint64_t time;
+        uint32_t message;
+        int32_t code;
+        uint8_t level;
+        uint8_t arg_count;
+        ArgKind kinds[max_args];
+        uint8_t padding[2];
+        // Integers are stored bit-for-bit, characters as their code and
+        // strings as the id of an interned string.
+        uint64_t args[max_args];
+    };
+
+    static_assert(sizeof(Record) == 56);
+    static_assert(std::is_trivially_copyable_v<Record>);
+}
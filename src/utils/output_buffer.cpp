@@ -0,0 +1,128 @@
+#include "output_buffer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+
+#include "log.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COSARCH_HAS_WRITEV 1
+
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#else
+#define COSARCH_HAS_WRITEV 0
+#endif
+
+OutputBuffer::OutputBuffer(const std::string &path) : m_path(path) {
+#if COSARCH_HAS_WRITEV
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        Log::error(2057, "File: " + path);
+    }
+#else
+    m_file = std::fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+        Log::error(2057, "File: " + path);
+    }
+#endif
+}
+
+OutputBuffer::~OutputBuffer() {
+    // An error unwinding the compilation (batch mode) abandons the file; a
+    // second error from flushing it would end the process.
+    if (std::uncaught_exceptions() > 0) {
+        m_chunks.clear();
+        m_pending = 0;
+    }
+    close();
+}
+
+std::string OutputBuffer::str() const {
+    std::string out;
+    out.reserve(m_pending);
+    for (const Chunk &chunk: m_chunks) {
+        out.append(chunk.data.get(), chunk.used);
+    }
+    return out;
+}
+
+void OutputBuffer::close() {
+    if (m_fd < 0 && m_file == nullptr) {
+        return;
+    }
+    write_pending();
+#if COSARCH_HAS_WRITEV
+    const int status = ::close(m_fd);
+    m_fd = -1;
+#else
+    const int status = std::fclose(m_file);
+    m_file = nullptr;
+#endif
+    if (status != 0) {
+        Log::error(2057, "File: " + m_path);
+    }
+}
+
+void OutputBuffer::add_chunk() {
+    if (m_pending >= stream_threshold && (m_fd >= 0 || m_file != nullptr)) {
+        write_pending();
+    }
+    Chunk chunk;
+    if (m_spare.empty()) {
+        chunk.data = std::make_unique_for_overwrite<char[]>(chunk_size);
+    } else {
+        chunk.data = std::move(m_spare.back());
+        m_spare.pop_back();
+    }
+    m_chunks.push_back(std::move(chunk));
+}
+
+void OutputBuffer::write_pending() {
+#if COSARCH_HAS_WRITEV
+    std::vector<iovec> parts;
+    parts.reserve(m_chunks.size());
+    for (const Chunk &chunk: m_chunks) {
+        if (chunk.used != 0) {
+            parts.push_back({chunk.data.get(), chunk.used});
+        }
+    }
+    // writev() takes at most IOV_MAX parts and may write less than asked.
+    size_t next = 0;
+    while (next < parts.size()) {
+        const size_t count = std::min<size_t>(parts.size() - next, IOV_MAX);
+        const ssize_t written = ::writev(m_fd, parts.data() + next, static_cast<int>(count));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Log::error(2057, "File: " + m_path);
+        }
+        auto remaining = static_cast<size_t>(written);
+        while (next < parts.size() && remaining >= parts[next].iov_len) {
+            remaining -= parts[next].iov_len;
+            ++next;
+        }
+        if (remaining != 0) {
+            parts[next].iov_base = static_cast<char *>(parts[next].iov_base) + remaining;
+            parts[next].iov_len -= remaining;
+        }
+    }
+#else
+    for (const Chunk &chunk: m_chunks) {
+        if (std::fwrite(chunk.data.get(), 1, chunk.used, m_file) != chunk.used) {
+            Log::error(2057, "File: " + m_path);
+        }
+    }
+#endif
+    m_written += m_pending;
+    m_pending = 0;
+    for (Chunk &chunk: m_chunks) {
+        m_spare.push_back(std::move(chunk.data));
+    }
+    m_chunks.clear();
+}
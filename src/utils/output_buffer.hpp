@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-only text buffer for generated output. Text goes into fixed-size
+// chunks, so appending never moves what is already buffered and, once the
+// chunks exist, allocates nothing. Bound to a file, the buffer writes every
+// pending chunk with a single writev() when it is closed, and streams chunks
+// out as soon as more than `stream_threshold` bytes are pending so that huge
+// programs never hold their whole listing in memory.
+class OutputBuffer {
+public:
+    static constexpr size_t chunk_size = 64 * 1024;
+    static constexpr size_t stream_threshold = 16 * chunk_size;
+
+    // In-memory buffer; read it back with str().
+    OutputBuffer() = default;
+
+    // Buffer that ends up in `path`. Raises error 2057 when the file cannot
+    // be opened or written.
+    explicit OutputBuffer(const std::string &path);
+
+    OutputBuffer(const OutputBuffer &) = delete;
+
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    ~OutputBuffer();
+
+    void append(char c) {
+        *reserve(1) = c;
+        commit(1);
+    }
+
+    void append(std::string_view text) {
+        while (!text.empty()) {
+            const size_t count = std::min(text.size(), chunk_size);
+            std::memcpy(reserve(count), text.data(), count);
+            commit(count);
+            text.remove_prefix(count);
+        }
+    }
+
+    // Decimal digits of `value`, two at a time from a lookup table.
+    void append_uint(uint64_t value) {
+        static constexpr char digit_pairs[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+        char digits[20];
+        char *end = digits + sizeof(digits);
+        char *begin = end;
+        while (value >= 100) {
+            const size_t pair = static_cast<size_t>(value % 100) * 2;
+            value /= 100;
+            *--begin = digit_pairs[pair + 1];
+            *--begin = digit_pairs[pair];
+        }
+        if (value >= 10) {
+            const size_t pair = static_cast<size_t>(value) * 2;
+            *--begin = digit_pairs[pair + 1];
+            *--begin = digit_pairs[pair];
+        } else {
+            *--begin = static_cast<char>('0' + value);
+        }
+        const auto count = static_cast<size_t>(end - begin);
+        std::memcpy(reserve(count), begin, count);
+        commit(count);
+    }
+
+    // Bytes appended so far, including those already written to the file.
+    [[nodiscard]] size_t size() const {
+        return m_written + m_pending;
+    }
+
+    // Contents that have not been written to a file yet.
+    [[nodiscard]] std::string str() const;
+
+    // Writes the pending chunks and closes the file. Called by the
+    // destructor if it has not been called before.
+    void close();
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t used = 0;
+    };
+
+    // Room for `count` contiguous bytes (at most chunk_size) at the end of
+    // the buffer.
+    char *reserve(size_t count) {
+        if (m_chunks.empty() || chunk_size - m_chunks.back().used < count) {
+            add_chunk();
+        }
+        Chunk &chunk = m_chunks.back();
+        return chunk.data.get() + chunk.used;
+    }
+
+    void commit(size_t count) {
+        m_chunks.back().used += count;
+        m_pending += count;
+    }
+
+    void add_chunk();
+
+    // Writes and recycles every chunk; the file position advances by
+    // m_pending bytes.
+    void write_pending();
+
+    std::vector<Chunk> m_chunks;
+    // Written chunks, kept for reuse so streaming does not reallocate.
+    std::vector<std::unique_ptr<char[]>> m_spare;
+    size_t m_pending = 0;
+    size_t m_written = 0;
+    std::string m_path;
+    int m_fd = -1;
+    std::FILE *m_file = nullptr;
+};
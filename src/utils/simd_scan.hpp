@@ -0,0 +1,261 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+// Vectorized scanners for the tokenizer's long runs: whitespace, comment
+// bodies and identifier/number runs. Each kernel takes [p, end) and returns a
+// pointer to the first byte that ends the run (or `end`). The SSE2 kernels
+// are the x86-64 baseline, AVX2 is picked at runtime when the CPU supports it,
+// and the scalar kernels are the reference every other level has to match.
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define COSARCH_SCAN_X86 1
+
+#include <immintrin.h>
+
+#else
+#define COSARCH_SCAN_X86 0
+#endif
+
+enum class ScanLevel {
+    scalar,
+    sse2,
+    avx2
+};
+
+// Every level is a struct with the same five static kernels, so the tokenizer
+// can be instantiated per level and call them directly:
+//   skip_whitespace   first byte that is not ' ', '\t', '\n', '\v', '\f' or '\r'
+//   ident_end         first byte that is not [A-Za-z0-9]
+//   digits_end        first byte that is not [0-9]
+//   find_newline      first '\n'
+//   find_comment_end  the '*' of the first "*/"
+struct ScalarScan {
+    static bool is_space(char c) {
+        return c == ' ' || static_cast<uint8_t>(c - '\t') <= '\r' - '\t';
+    }
+
+    static bool is_digit(char c) {
+        return static_cast<uint8_t>(c - '0') <= 9;
+    }
+
+    static bool is_alnum(char c) {
+        return is_digit(c) || static_cast<uint8_t>((c | 0x20) - 'a') <= 'z' - 'a';
+    }
+
+    static const char *skip_whitespace(const char *p, const char *end) {
+        while (p < end && is_space(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    static const char *ident_end(const char *p, const char *end) {
+        while (p < end && is_alnum(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    static const char *digits_end(const char *p, const char *end) {
+        while (p < end && is_digit(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    static const char *find_newline(const char *p, const char *end) {
+        while (p < end && *p != '\n') {
+            ++p;
+        }
+        return p;
+    }
+
+    static const char *find_comment_end(const char *p, const char *end) {
+        while (p + 1 < end) {
+            if (p[0] == '*' && p[1] == '/') {
+                return p;
+            }
+            ++p;
+        }
+        return end;
+    }
+};
+
+#if COSARCH_SCAN_X86
+struct Sse2Scan {
+    // Lanes in [lo, lo + span] are set; relies on unsigned wrap-around.
+    static __m128i in_range(__m128i v, char lo, char span) {
+        const __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+        return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+    }
+
+    static __m128i space_mask(__m128i v) {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), in_range(v, '\t', '\r' - '\t'));
+    }
+
+    static __m128i alnum_mask(__m128i v) {
+        const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        return _mm_or_si128(in_range(v, '0', 9), in_range(lower, 'a', 'z' - 'a'));
+    }
+
+    static __m128i load(const char *p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+
+    // Index of the first lane that is *not* set in `mask`, or 16.
+    static unsigned first_clear(__m128i mask) {
+        const auto clear = ~static_cast<unsigned>(_mm_movemask_epi8(mask)) & 0xFFFFu;
+        return clear == 0 ? 16 : std::countr_zero(clear);
+    }
+
+    static unsigned first_set(__m128i mask) {
+        const auto set = static_cast<unsigned>(_mm_movemask_epi8(mask));
+        return set == 0 ? 16 : std::countr_zero(set);
+    }
+
+    static const char *skip_whitespace(const char *p, const char *end) {
+        for (; end - p >= 16; p += 16) {
+            if (const unsigned i = first_clear(space_mask(load(p))); i < 16) {
+                return p + i;
+            }
+        }
+        return ScalarScan::skip_whitespace(p, end);
+    }
+
+    static const char *ident_end(const char *p, const char *end) {
+        for (; end - p >= 16; p += 16) {
+            if (const unsigned i = first_clear(alnum_mask(load(p))); i < 16) {
+                return p + i;
+            }
+        }
+        return ScalarScan::ident_end(p, end);
+    }
+
+    static const char *digits_end(const char *p, const char *end) {
+        for (; end - p >= 16; p += 16) {
+            if (const unsigned i = first_clear(in_range(load(p), '0', 9)); i < 16) {
+                return p + i;
+            }
+        }
+        return ScalarScan::digits_end(p, end);
+    }
+
+    static const char *find_newline(const char *p, const char *end) {
+        for (; end - p >= 16; p += 16) {
+            if (const unsigned i = first_set(_mm_cmpeq_epi8(load(p), _mm_set1_epi8('\n'))); i < 16) {
+                return p + i;
+            }
+        }
+        return ScalarScan::find_newline(p, end);
+    }
+
+    static const char *find_comment_end(const char *p, const char *end) {
+        for (; end - p >= 17; p += 16) {
+            const __m128i star = _mm_cmpeq_epi8(load(p), _mm_set1_epi8('*'));
+            const __m128i slash = _mm_cmpeq_epi8(load(p + 1), _mm_set1_epi8('/'));
+            if (const unsigned i = first_set(_mm_and_si128(star, slash)); i < 16) {
+                return p + i;
+            }
+        }
+        return ScalarScan::find_comment_end(p, end);
+    }
+};
+
+#define COSARCH_AVX2 __attribute__((target("avx2")))
+
+struct Avx2Scan {
+    COSARCH_AVX2 static __m256i in_range(__m256i v, char lo, char span) {
+        const __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)), shifted);
+    }
+
+    COSARCH_AVX2 static __m256i space_mask(__m256i v) {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), in_range(v, '\t', '\r' - '\t'));
+    }
+
+    COSARCH_AVX2 static __m256i alnum_mask(__m256i v) {
+        const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        return _mm256_or_si256(in_range(v, '0', 9), in_range(lower, 'a', 'z' - 'a'));
+    }
+
+    COSARCH_AVX2 static __m256i load(const char *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+
+    COSARCH_AVX2 static unsigned first_clear(__m256i mask) {
+        const auto clear = ~static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+        return clear == 0 ? 32 : std::countr_zero(clear);
+    }
+
+    COSARCH_AVX2 static unsigned first_set(__m256i mask) {
+        const auto set = static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+        return set == 0 ? 32 : std::countr_zero(set);
+    }
+
+    COSARCH_AVX2 static const char *skip_whitespace(const char *p, const char *end) {
+        for (; end - p >= 32; p += 32) {
+            if (const unsigned i = first_clear(space_mask(load(p))); i < 32) {
+                return p + i;
+            }
+        }
+        return Sse2Scan::skip_whitespace(p, end);
+    }
+
+    COSARCH_AVX2 static const char *ident_end(const char *p, const char *end) {
+        for (; end - p >= 32; p += 32) {
+            if (const unsigned i = first_clear(alnum_mask(load(p))); i < 32) {
+                return p + i;
+            }
+        }
+        return Sse2Scan::ident_end(p, end);
+    }
+
+    COSARCH_AVX2 static const char *digits_end(const char *p, const char *end) {
+        for (; end - p >= 32; p += 32) {
+            if (const unsigned i = first_clear(in_range(load(p), '0', 9)); i < 32) {
+                return p + i;
+            }
+        }
+        return Sse2Scan::digits_end(p, end);
+    }
+
+    COSARCH_AVX2 static const char *find_newline(const char *p, const char *end) {
+        for (; end - p >= 32; p += 32) {
+            if (const unsigned i = first_set(_mm256_cmpeq_epi8(load(p), _mm256_set1_epi8('\n'))); i < 32) {
+                return p + i;
+            }
+        }
+        return Sse2Scan::find_newline(p, end);
+    }
+
+    COSARCH_AVX2 static const char *find_comment_end(const char *p, const char *end) {
+        for (; end - p >= 33; p += 32) {
+            const __m256i star = _mm256_cmpeq_epi8(load(p), _mm256_set1_epi8('*'));
+            const __m256i slash = _mm256_cmpeq_epi8(load(p + 1), _mm256_set1_epi8('/'));
+            if (const unsigned i = first_set(_mm256_and_si256(star, slash)); i < 32) {
+                return p + i;
+            }
+        }
+        return Sse2Scan::find_comment_end(p, end);
+    }
+};
+
+#undef COSARCH_AVX2
+#endif
+
+// Highest level supported by both the build and the running CPU.
+inline ScanLevel best_scan_level() {
+#if COSARCH_SCAN_X86
+    static const ScanLevel level = __builtin_cpu_supports("avx2") ? ScanLevel::avx2 : ScanLevel::sse2;
+    return level;
+#else
+    return ScanLevel::scalar;
+#endif
+}
+
+// `level` clamped to what the build and the running CPU support.
+inline ScanLevel supported_scan_level(ScanLevel level) {
+    return level > best_scan_level() ? best_scan_level() : level;
+}
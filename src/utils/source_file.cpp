@@ -0,0 +1,134 @@
+#include "source_file.hpp"
+
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include "log.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COSARCH_HAS_MMAP 1
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#else
+#define COSARCH_HAS_MMAP 0
+#endif
+
+#if COSARCH_HAS_MMAP
+namespace {
+    // Closes a descriptor when it goes out of scope, also when Log::error()
+    // throws (batch mode), so a failed read does not leak it.
+    class FileDescriptorGuard {
+    public:
+        explicit FileDescriptorGuard(int fd) : m_fd(fd) {
+        }
+
+        FileDescriptorGuard(const FileDescriptorGuard &) = delete;
+
+        FileDescriptorGuard &operator=(const FileDescriptorGuard &) = delete;
+
+        ~FileDescriptorGuard() {
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+        }
+
+    private:
+        int m_fd;
+    };
+}
+#endif
+
+SourceFile::SourceFile(const std::string &path) {
+#if COSARCH_HAS_MMAP
+    const bool is_stdin = path == "-";
+    const int fd = is_stdin ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Log::error(2056, "File: " + path);
+    }
+    // Standard input stays open.
+    const FileDescriptorGuard guard(is_stdin ? -1 : fd);
+
+    struct stat info{};
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            m_mapped = static_cast<const char *>(mapped);
+            m_size = static_cast<size_t>(info.st_size);
+        }
+    }
+    // Pipes, character devices and failed mappings are streamed instead.
+    if (m_mapped == nullptr && !read_stream(fd)) {
+        Log::error(2056, "File: " + path);
+    }
+#else
+    if (path == "-") {
+        std::stringstream contents_stream;
+        contents_stream << std::cin.rdbuf();
+        m_buffer = contents_stream.str();
+        return;
+    }
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    if (!input) {
+        Log::error(2056, "File: " + path);
+    }
+    std::stringstream contents_stream;
+    contents_stream << input.rdbuf();
+    m_buffer = contents_stream.str();
+#endif
+}
+
+SourceFile::SourceFile(SourceFile &&other) noexcept
+        : m_mapped{std::exchange(other.m_mapped, nullptr)}, m_size{std::exchange(other.m_size, 0)},
+          m_buffer{std::move(other.m_buffer)} {
+}
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept {
+    std::swap(m_mapped, other.m_mapped);
+    std::swap(m_size, other.m_size);
+    std::swap(m_buffer, other.m_buffer);
+    return *this;
+}
+
+SourceFile::~SourceFile() {
+    unmap();
+}
+
+void SourceFile::unmap() {
+#if COSARCH_HAS_MMAP
+    if (m_mapped != nullptr) {
+        munmap(const_cast<char *>(m_mapped), m_size);
+    }
+#endif
+    m_mapped = nullptr;
+    m_size = 0;
+}
+
+bool SourceFile::read_stream(int fd) {
+#if COSARCH_HAS_MMAP
+    char chunk[64 * 1024];
+    while (true) {
+        const ssize_t num_read = ::read(fd, chunk, sizeof(chunk));
+        if (num_read == 0) {
+            return true;
+        }
+        if (num_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        m_buffer.append(chunk, static_cast<size_t>(num_read));
+    }
+#else
+    (void) fd;
+    return false;
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file. Regular files are memory-mapped, so the
+// tokenizer reads straight from the page cache without copying the input.
+// Standard input ("-"), pipes and platforms without mmap fall back to
+// streaming the bytes into an owned buffer.
+class SourceFile {
+public:
+    explicit SourceFile(const std::string &path);
+
+    SourceFile(const SourceFile &) = delete;
+
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    SourceFile(SourceFile &&other) noexcept;
+
+    SourceFile &operator=(SourceFile &&other) noexcept;
+
+    ~SourceFile();
+
+    [[nodiscard]] std::string_view view() const {
+        if (m_mapped != nullptr) {
+            return {m_mapped, m_size};
+        }
+        return m_buffer;
+    }
+
+    [[nodiscard]] bool is_mapped() const {
+        return m_mapped != nullptr;
+    }
+
+private:
+    void unmap();
+
+    bool read_stream(int fd);
+
+    const char *m_mapped = nullptr;
+    size_t m_size = 0;
+    std::string m_buffer;
+};
@@ -0,0 +1,61 @@
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t)> &task) {
+    for (size_t index = 0; index < count; ++index) {
+        m_queues[index % m_queues.size()]->tasks.push_back(index);
+    }
+    // No point in starting threads that could only find nothing to steal.
+    const size_t workers = std::min(m_queues.size(), count);
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < workers; ++worker) {
+        threads.emplace_back([this, worker, &task] { work(worker, task); });
+    }
+    work(0, task);
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::work(size_t worker, const std::function<void(size_t)> &task) {
+    // Nothing is queued while the pool runs, so once every deque is empty
+    // this worker is done.
+    for (size_t index = 0; pop(worker, index) || steal(worker, index);) {
+        task(index);
+    }
+}
+
+bool WorkStealingPool::pop(size_t worker, size_t &task) {
+    Queue &queue = *m_queues[worker];
+    const std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, size_t &task) {
+    for (size_t offset = 1; offset < m_queues.size(); ++offset) {
+        Queue &victim = *m_queues[(thief + offset) % m_queues.size()];
+        const std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
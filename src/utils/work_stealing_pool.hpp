@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs a batch of independent tasks on a fixed number of threads. Task
+// indices are dealt round-robin onto one deque per worker. A worker takes its
+// own tasks from the front, in the order they were dealt, and once its deque
+// is empty steals from the back of the others'. A few long tasks therefore
+// never leave the remaining threads idle while work is queued behind them.
+//
+// Tasks are coarse (a whole compilation), so each deque is guarded by its own
+// mutex rather than being lock-free; a worker only contends on a lock when it
+// steals.
+class WorkStealingPool {
+public:
+    // 0 threads means one per hardware thread.
+    explicit WorkStealingPool(size_t threads = 0);
+
+    [[nodiscard]] size_t size() const {
+        return m_queues.size();
+    }
+
+    // Calls task(index) for every index in [0, count) and returns when all
+    // have finished. The calling thread is one of the workers. Tasks must
+    // not throw.
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    [[nodiscard]] bool pop(size_t worker, size_t &task);
+
+    [[nodiscard]] bool steal(size_t thief, size_t &task);
+
+    void work(size_t worker, const std::function<void(size_t)> &task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+};
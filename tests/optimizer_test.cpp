@@ -0,0 +1,43 @@
+// The optimisation levels must not change what a program does: every
+// program here has to end the same way at -O0, -O1 and -O2. In particular,
+// x * 0 may only fold to 0 when evaluating x cannot divide by zero.
+
+#include <csignal>
+#include <string_view>
+
+#include "test_support.hpp"
+
+namespace {
+    using TestSupport::Outcome;
+
+    constexpr Outcome traps = {.signaled = true, .value = SIGFPE};
+
+    struct Case {
+        std::string_view src;
+        Outcome expected;
+    };
+
+    constexpr Case cases[] = {
+            {"exit((1 / 0) * 0);", traps},
+            {"exit(0 * (1 / 0));", traps},
+            {"exit(((7 / 0) + 3) * 0);", traps},
+            {"let z = 0;\nexit((5 / z) * 0);", traps},
+            {"let a = 4;\nexit((a / (a - 4)) * 0 + 1);", traps},
+            {"let d = (1 / 0) * 0;\nexit(2);", traps},
+            {"exit((6 / 3) * 0);", {.signaled = false, .value = 0}},
+            {"let a = 5;\nexit(a * 0 + 9);", {.signaled = false, .value = 9}},
+            {"let a = 5;\nexit((a / 5) * 0 + (a * 1) / 1);", {.signaled = false, .value = 5}},
+    };
+}
+
+int main() {
+    for (const Case &test: cases) {
+        for (int opt_level = 0; opt_level <= 2; ++opt_level) {
+            const Outcome outcome = TestSupport::run(TestSupport::compile(test.src, opt_level));
+            TestSupport::check(outcome == test.expected,
+                               "-O" + std::to_string(opt_level) + " `" + std::string(test.src) + "`: " +
+                               TestSupport::describe(outcome) + ", expected " + TestSupport::describe(test.expected));
+        }
+    }
+    return TestSupport::finish();
+}
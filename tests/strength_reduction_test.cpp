@@ -0,0 +1,231 @@
+// Multiplication and division by constants, run through the generator's
+// strength reduction (shifts, lea and magic-number division). Source programs
+// only reach it at -O0, since from -O1 the optimizers fold all constant
+// arithmetic; the bulk of the cases below are hand-built IR, which can put
+// any value and constant next to each other.
+
+#include <algorithm>
+#include <bit>
+#include <csignal>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "test_support.hpp"
+
+namespace {
+    using TestSupport::Outcome;
+
+    struct Case {
+        IrOp op;
+        uint64_t x;
+        uint64_t constant;
+        // mul only: `constant * x` instead of `x * constant`.
+        bool constant_first = false;
+        // Both operands immediate, as left over when nothing folded them.
+        bool both_imm = false;
+
+        [[nodiscard]] uint64_t expected() const {
+            return op == IrOp::mul ? x * constant : x / constant;
+        }
+
+        [[nodiscard]] std::string describe() const {
+            const std::string value = both_imm ? std::to_string(x) : "v(" + std::to_string(x) + ")";
+            const std::string constant_text = std::to_string(constant);
+            if (op == IrOp::div) {
+                return value + " / " + constant_text;
+            }
+            return constant_first ? constant_text + " * " + value : value + " * " + constant_text;
+        }
+    };
+
+    // Every case computes its result, compares it and x (which must be left
+    // alone) with what they should be, and branches to the failure block on
+    // a mismatch:
+    //
+    //   b2i:    v0 = add x, 0          ; a value, not an immediate
+    //           v1 = mul v0, c         ; or mul c, v0 / div v0, d
+    //           v2 = sub v1, expected
+    //           v3 = sub v0, x
+    //           branch v2, fail, b2i+1
+    //   b2i+1:  branch v3, fail, b2i+2
+    //
+    // then `exit 0`, and the failure block `exit 1`.
+    IrProgram build(std::span<const Case> cases) {
+        IrProgram program;
+        const auto success = static_cast<BlockId>(2 * cases.size());
+        const BlockId fail = success + 1;
+        for (const Case &test: cases) {
+            const auto first = static_cast<BlockId>(program.blocks.size());
+            const ValueId v0 = program.num_values;
+            program.num_values += 4;
+
+            IrBlock &compute = program.blocks.emplace_back();
+            compute.insts.push_back({IrOp::add, v0, IrArg::constant(test.x), IrArg::constant(0)});
+            const IrArg value = test.both_imm ? IrArg::constant(test.x) : IrArg::of(v0);
+            const IrArg constant = IrArg::constant(test.constant);
+            if (test.constant_first) {
+                compute.insts.push_back({test.op, v0 + 1, constant, value});
+            } else {
+                compute.insts.push_back({test.op, v0 + 1, value, constant});
+            }
+            compute.insts.push_back({IrOp::sub, v0 + 2, IrArg::of(v0 + 1), IrArg::constant(test.expected())});
+            compute.insts.push_back({IrOp::sub, v0 + 3, IrArg::of(v0), IrArg::constant(test.x)});
+            compute.term = {.kind = TermKind::branch, .arg = IrArg::of(v0 + 2), .target = fail, .other = first + 1};
+
+            IrBlock &check = program.blocks.emplace_back();
+            check.term = {.kind = TermKind::branch, .arg = IrArg::of(v0 + 3), .target = fail, .other = first + 2};
+        }
+        program.blocks.emplace_back().term = {.kind = TermKind::exit, .arg = IrArg::constant(0)};
+        program.blocks.emplace_back().term = {.kind = TermKind::exit, .arg = IrArg::constant(1)};
+
+        // Fills in the predecessor lists.
+        std::vector<BlockId> order(program.blocks.size());
+        std::iota(order.begin(), order.end(), 0);
+        reorder_blocks(program, order);
+        return program;
+    }
+
+    std::vector<Case> make_cases() {
+        std::mt19937_64 random(20260417);
+        std::vector<uint64_t> xs = {0, 1, 2, 3, 7, 100, 0x7fffffff, 0x80000000, 0xffffffff, 0x100000000,
+                                    0x123456789abcdef, uint64_t{1} << 63, UINT64_MAX - 1, UINT64_MAX};
+        for (int i = 0; i < 6; ++i) {
+            xs.push_back(random());
+        }
+        xs.push_back(random() >> 32);
+        xs.push_back(random() >> 48);
+
+        // 0..64, then 2^k, 3*2^k, 5*2^k and 9*2^k (the lea forms), then
+        // constants that need imul.
+        std::vector<uint64_t> factors(65);
+        std::iota(factors.begin(), factors.end(), 0);
+        for (int shift = 0; shift < 64; ++shift) {
+            for (const uint64_t odd: {1, 3, 5, 9}) {
+                if (std::countl_zero(odd) >= shift) {
+                    factors.push_back(odd << shift);
+                }
+            }
+        }
+        for (int i = 0; i < 16; ++i) {
+            factors.push_back(random());
+        }
+        factors.push_back(0x7fffffff);
+        factors.push_back(0x80000000);
+        factors.push_back(UINT64_MAX);
+
+        // 1..64, then powers of two, divisors whose magic number needs the
+        // add fix-up (7, 641, ...), and the largest ones.
+        std::vector<uint64_t> divisors(64);
+        std::iota(divisors.begin(), divisors.end(), 1);
+        for (int shift = 6; shift < 64; ++shift) {
+            divisors.push_back(uint64_t{1} << shift);
+        }
+        divisors.insert(divisors.end(), {641, 1000, 6700417, 0x7fffffff, 0x80000001, uint64_t{1} << 63 | 1,
+                                         UINT64_MAX - 1, UINT64_MAX});
+        for (int i = 0; i < 16; ++i) {
+            divisors.push_back(random() >> (i * 4) | 1);
+        }
+
+        std::vector<Case> cases;
+        for (const uint64_t x: xs) {
+            for (const uint64_t factor: factors) {
+                cases.push_back({.op = IrOp::mul, .x = x, .constant = factor});
+                cases.push_back({.op = IrOp::mul, .x = x, .constant = factor, .constant_first = true});
+            }
+            for (const uint64_t divisor: divisors) {
+                cases.push_back({.op = IrOp::div, .x = x, .constant = divisor});
+            }
+        }
+        for (const uint64_t x: {uint64_t{0}, uint64_t{12345}, UINT64_MAX}) {
+            for (const uint64_t constant: {uint64_t{1}, uint64_t{6}, uint64_t{8}, uint64_t{641}, UINT64_MAX}) {
+                cases.push_back({.op = IrOp::mul, .x = x, .constant = constant, .both_imm = true});
+                cases.push_back({.op = IrOp::div, .x = x, .constant = constant, .both_imm = true});
+            }
+        }
+        return cases;
+    }
+
+    // Cases per executable. A failing batch is run again case by case to
+    // name the cases that fail.
+    constexpr size_t batch_size = 500;
+
+    bool passes(std::span<const Case> cases, size_t num_regs, int opt_level) {
+        const Outcome outcome = TestSupport::run(TestSupport::generate(build(cases), num_regs, opt_level));
+        return outcome == Outcome{.signaled = false, .value = 0};
+    }
+
+    struct SourceCase {
+        std::string_view src;
+        int exit_code;
+    };
+
+    // At -O0 these keep their multiplications and divisions by constants up
+    // to the generator, which must not emit a single div for them.
+    constexpr SourceCase source_cases[] = {
+            {"let a = 100;\nexit(a / 7);", 14},
+            {"let a = 1000;\nexit(a / 10);", 100},
+            {"let a = 12345;\nexit(a / 641);", 19},
+            {"let a = 255;\nexit(a / 16 * 3);", 45},
+            {"let a = 7;\nexit(a * 9 + a * 40);", 87},
+            {"let a = 100;\nlet b = a * 10;\nexit(b / 7 + a * 3);", 186},
+    };
+
+    [[nodiscard]] size_t count_divs(std::string_view src) {
+        Interner names;
+        Tokenizer tokenizer(src, names);
+        Parser parser(tokenizer.tokenize(), src);
+        std::optional<Ast> prog = parser.parse_prog();
+        const IrProgram ir = IrBuilder(prog.value(), names).build();
+        const std::vector<Instr> code = Generator(ir).gen_prog();
+        return static_cast<size_t>(std::count_if(code.begin(), code.end(),
+                                                 [](const Instr &instr) { return instr.op == Opcode::div; }));
+    }
+}
+
+int main() {
+    for (const SourceCase &test: source_cases) {
+        const Outcome outcome = TestSupport::run(TestSupport::compile(test.src, 0));
+        TestSupport::check(outcome == Outcome{.signaled = false, .value = test.exit_code},
+                           "-O0 `" + std::string(test.src) + "`: " + TestSupport::describe(outcome) +
+                           ", expected exit " + std::to_string(test.exit_code));
+        TestSupport::check(count_divs(test.src) == 0, "-O0 `" + std::string(test.src) + "` still divides");
+    }
+
+    // The peephole optimizer (-O2) must keep the lowered code intact.
+    const std::vector<Case> cases = make_cases();
+    for (const size_t num_regs: {allocatable_regs.size(), size_t{1}}) {
+        for (const int opt_level: {0, 2}) {
+            const std::string config = "-O" + std::to_string(opt_level) + " --regs=" + std::to_string(num_regs);
+            for (size_t begin = 0; begin < cases.size(); begin += batch_size) {
+                const std::span<const Case> batch =
+                        std::span(cases).subspan(begin, std::min(batch_size, cases.size() - begin));
+                if (passes(batch, num_regs, opt_level)) {
+                    continue;
+                }
+                for (const Case &test: batch) {
+                    TestSupport::check(passes({&test, 1}, num_regs, opt_level),
+                                       config + " `" + test.describe() + "` is not " +
+                                       std::to_string(test.expected()));
+                }
+            }
+
+            // Division by a constant zero still has to trap.
+            IrProgram program;
+            program.num_values = 2;
+            IrBlock &block = program.blocks.emplace_back();
+            block.insts = {{IrOp::add, 0, IrArg::constant(5), IrArg::constant(0)},
+                           {IrOp::div, 1, IrArg::of(0), IrArg::constant(0)}};
+            block.term = {.kind = TermKind::exit, .arg = IrArg::of(1)};
+            const Outcome outcome = TestSupport::run(TestSupport::generate(program, num_regs, opt_level));
+            TestSupport::check(outcome == Outcome{.signaled = true, .value = SIGFPE},
+                               config + " `v(5) / 0`: " + TestSupport::describe(outcome) + ", expected signal " +
+                               std::to_string(SIGFPE));
+        }
+    }
+    return TestSupport::finish();
+}
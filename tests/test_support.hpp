@@ -0,0 +1,106 @@
+#pragma once
+
+// Shared by the regression tests: runs the compiler pipeline in-process,
+// writes the result as an executable and runs it. Every test is its own
+// program that prints what failed and exits non-zero.
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/encoder.hpp"
+#include "../src/generation.hpp"
+#include "../src/ir_builder.hpp"
+#include "../src/ir_optimizer.hpp"
+#include "../src/optimizer.hpp"
+#include "../src/parser.hpp"
+#include "../src/peephole.hpp"
+#include "../src/tokenization.hpp"
+#include "../src/utils/elf_writer.hpp"
+
+namespace TestSupport {
+    // How an executable ended: its exit status, or the signal that killed it.
+    struct Outcome {
+        bool signaled = false;
+        int value = 0;
+
+        bool operator==(const Outcome &) const = default;
+    };
+
+    inline std::string describe(const Outcome &outcome) {
+        return (outcome.signaled ? "signal " : "exit ") + std::to_string(outcome.value);
+    }
+
+    inline int failures = 0;
+
+    inline void check(bool condition, const std::string &what) {
+        if (!condition) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    // Code of hand-built `ir`; the peephole optimizer runs from -O2.
+    inline std::vector<uint8_t> generate(const IrProgram &ir, size_t num_regs, int opt_level) {
+        std::vector<Instr> code = Generator(ir, num_regs).gen_prog();
+        if (opt_level >= 2) {
+            (void) Peephole().run(code);
+        }
+        return X86Encoder().encode(code);
+    }
+
+    // Code of `src` at -O`opt_level`, like the driver builds it.
+    inline std::vector<uint8_t> compile(std::string_view src, int opt_level) {
+        Interner names;
+        Tokenizer tokenizer(src, names);
+        Parser parser(tokenizer.tokenize(), src);
+        std::optional<Ast> prog = parser.parse_prog();
+        if (opt_level >= 1) {
+            (void) Optimizer(prog.value(), names).run();
+        }
+        IrProgram ir = IrBuilder(prog.value(), names).build();
+        if (opt_level >= 1) {
+            (void) IrOptimizer().run(ir);
+        }
+        return generate(ir, allocatable_regs.size(), opt_level);
+    }
+
+    inline Outcome run(std::span<const uint8_t> code) {
+        char path[] = "/tmp/cosarch_test.XXXXXX";
+        const int fd = mkstemp(path);
+        if (fd < 0) {
+            std::perror("mkstemp");
+            std::exit(EXIT_FAILURE);
+        }
+        close(fd);
+        write_elf_executable(path, code);
+        const pid_t pid = fork();
+        if (pid == 0) {
+            execl(path, path, nullptr);
+            _exit(127);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        unlink(path);
+        if (WIFSIGNALED(status)) {
+            return {.signaled = true, .value = WTERMSIG(status)};
+        }
+        return {.signaled = false, .value = WEXITSTATUS(status)};
+    }
+
+    inline int finish() {
+        if (failures != 0) {
+            std::cerr << failures << " check(s) failed" << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+}
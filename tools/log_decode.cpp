@@ -0,0 +1,208 @@
+// Renders a binary compiler log (`<time>.cslog`, see src/utils/log_format.hpp)
+// as text:
+//
+//   cosarch_log_decode <file.cslog>
+//
+// The output matches the text log the compiler used to write: a summary of
+// entry counts per level, one line per entry in time order, and the exit code.
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/utils/log_format.hpp"
+
+namespace {
+    constexpr std::string_view level_names[] = {
+            "Process", "Info", "Log", "Success", "Warning", "Fatal", "Error",
+    };
+
+    class Reader {
+    public:
+        explicit Reader(std::string_view data) : m_data(data) {
+        }
+
+        template<typename Value>
+        bool read(Value &value) {
+            if (m_data.size() - m_offset < sizeof(Value)) {
+                return false;
+            }
+            std::memcpy(&value, m_data.data() + m_offset, sizeof(Value));
+            m_offset += sizeof(Value);
+            return true;
+        }
+
+        bool read_bytes(std::string &out, size_t size) {
+            if (m_data.size() - m_offset < size) {
+                return false;
+            }
+            out.assign(m_data.substr(m_offset, size));
+            m_offset += size;
+            return true;
+        }
+
+        [[nodiscard]] bool at_end() const {
+            return m_offset == m_data.size();
+        }
+
+    private:
+        std::string_view m_data;
+        size_t m_offset = 0;
+    };
+
+    std::string format_time(uint64_t unix_ns) {
+        const auto seconds = static_cast<time_t>(unix_ns / 1000000000);
+        std::tm bt{};
+#ifdef _WIN32
+        localtime_s(&bt, &seconds);
+#else
+        localtime_r(&seconds, &bt);
+#endif
+        std::ostringstream oss;
+        oss << std::put_time(&bt, "%Y-%m-%d %H:%M:%S");
+        oss << '.' << std::setfill('0') << std::setw(9) << unix_ns % 1000000000;
+        return oss.str();
+    }
+
+    std::string lookup(const std::unordered_map<uint32_t, std::string> &strings, uint64_t id) {
+        if (const auto it = strings.find(static_cast<uint32_t>(id)); it != strings.end()) {
+            return it->second;
+        }
+        return "<string " + std::to_string(id) + "?>";
+    }
+
+    std::string render(const LogFormat::Record &entry, const std::unordered_map<uint32_t, std::string> &strings) {
+        const std::string message = lookup(strings, entry.message);
+        std::string out;
+        size_t arg = 0;
+        size_t begin = 0;
+        for (size_t hole = message.find("{}"); hole != std::string::npos; hole = message.find("{}", begin)) {
+            out.append(message, begin, hole - begin);
+            begin = hole + 2;
+            if (arg >= entry.arg_count || arg >= LogFormat::max_args) {
+                out += "{}";
+                continue;
+            }
+            const uint64_t value = entry.args[arg];
+            switch (entry.kinds[arg]) {
+                case LogFormat::ArgKind::unsigned_int:
+                    out += std::to_string(value);
+                    break;
+                case LogFormat::ArgKind::signed_int:
+                    out += std::to_string(static_cast<int64_t>(value));
+                    break;
+                case LogFormat::ArgKind::character:
+                    out += static_cast<char>(value);
+                    break;
+                case LogFormat::ArgKind::string:
+                    out += lookup(strings, value);
+                    break;
+                case LogFormat::ArgKind::none:
+                    break;
+            }
+            ++arg;
+        }
+        out.append(message, begin);
+        return out;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: cosarch_log_decode <file.cslog>" << std::endl;
+        return 1;
+    }
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Reader reader(data);
+    char magic[sizeof(LogFormat::magic)];
+    uint64_t start = 0;
+    if (!reader.read(magic) || std::memcmp(magic, LogFormat::magic, sizeof(magic)) != 0 || !reader.read(start)) {
+        std::cerr << argv[1] << " is not a compiler log" << std::endl;
+        return 1;
+    }
+
+    std::unordered_map<uint32_t, std::string> strings;
+    std::vector<LogFormat::Record> records;
+    std::optional<int32_t> exit_code;
+    while (!reader.at_end() && !exit_code.has_value()) {
+        LogFormat::Chunk kind{};
+        bool complete = reader.read(kind);
+        switch (kind) {
+            case LogFormat::Chunk::string: {
+                uint32_t id = 0;
+                uint32_t size = 0;
+                std::string text;
+                complete = complete && reader.read(id) && reader.read(size) && reader.read_bytes(text, size);
+                strings[id] = std::move(text);
+                break;
+            }
+            case LogFormat::Chunk::records: {
+                uint32_t count = 0;
+                complete = complete && reader.read(count);
+                for (uint32_t i = 0; complete && i < count; ++i) {
+                    LogFormat::Record entry{};
+                    complete = reader.read(entry);
+                    records.push_back(entry);
+                }
+                break;
+            }
+            case LogFormat::Chunk::end: {
+                int32_t code = 0;
+                complete = complete && reader.read(code);
+                exit_code = code;
+                break;
+            }
+            default:
+                complete = false;
+                break;
+        }
+        if (!complete) {
+            break;
+        }
+    }
+
+    size_t counts[std::size(level_names)] = {};
+    for (const LogFormat::Record &entry: records) {
+        if (entry.level < std::size(level_names)) {
+            ++counts[entry.level];
+        }
+    }
+    std::cout << "Log file generated at " << format_time(start) << std::endl;
+    std::cout << "Warnings: " << counts[4] << std::endl;
+    std::cout << "Infos: " << counts[1] << std::endl;
+    std::cout << "Error: " << counts[6] << std::endl;
+    std::cout << "Fatal: " << counts[5] << std::endl;
+    std::cout << "Log: " << counts[2] << std::endl;
+    std::cout << "Success: " << counts[3] << std::endl;
+    std::cout << "Process: " << counts[0] << std::endl;
+
+    // Records are written in the order they were made, which is time order.
+    for (const LogFormat::Record &entry: records) {
+        const std::string_view level = entry.level < std::size(level_names) ? level_names[entry.level] : "?";
+        std::cout << format_time(start + entry.time) << " " << entry.time << ": " << level << ": "
+                  << render(entry, strings) << "  " << entry.code << '\n';
+    }
+
+    if (exit_code.has_value()) {
+        std::cout << "Exit code: " << *exit_code << std::endl;
+    } else {
+        std::cout << "Log truncated: the compiler did not finish writing it" << std::endl;
+    }
+    return 0;
+}